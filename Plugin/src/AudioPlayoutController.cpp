@@ -0,0 +1,359 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "AudioPlayoutController.h"
+#include "DebugLog.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const gchar* SINK_KIND = "audio-sink-kind";
+
+AudioPlayoutController::~AudioPlayoutController()
+{
+    Detach();
+    if (resampler_ != nullptr)
+        gst_audio_resampler_free(resampler_);
+}
+
+void AudioPlayoutController::Configure(const Config& config)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    config_ = config;
+    config_.max_ms = std::max(config_.max_ms, config_.target_ms * 2);
+    configure_queue();
+}
+
+AudioPlayoutController::Config AudioPlayoutController::GetConfig() const
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    return config_;
+}
+
+void AudioPlayoutController::Attach(GstElement* queue, GstElement* sink)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    detach();
+
+    queue_ = GST_ELEMENT(gst_object_ref(queue));
+    sink_ = GST_ELEMENT(gst_object_ref(sink));
+    configure_queue();
+    underrun_handler_ = g_signal_connect(queue_, "underrun", G_CALLBACK(on_underrun), this);
+    overrun_handler_ = g_signal_connect(queue_, "overrun", G_CALLBACK(on_overrun), this);
+
+    pad_ = gst_element_get_static_pad(queue_, "src");
+    probe_ = gst_pad_add_probe(pad_, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                               probe, this, nullptr);
+    prebuffering_ = true;
+}
+
+void AudioPlayoutController::Detach()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    detach();
+}
+
+// Call with lock_ held
+void AudioPlayoutController::detach()
+{
+    if (pad_ != nullptr)
+    {
+        gst_pad_remove_probe(pad_, probe_);
+        gst_clear_object(&pad_);
+    }
+    if (queue_ != nullptr)
+    {
+        g_signal_handler_disconnect(queue_, underrun_handler_);
+        g_signal_handler_disconnect(queue_, overrun_handler_);
+        gst_clear_object(&queue_);
+    }
+    gst_clear_object(&sink_);
+}
+
+// Call with lock_ held
+void AudioPlayoutController::configure_queue()
+{
+    if (queue_ == nullptr)
+        return;
+
+    /* A real device or the ring reader paces the playout by itself, the test sinks follow the pipeline clock instead */
+    const bool paced = IsSinkKind(sink_, AudioSinkKind::Device) || IsSinkKind(sink_, AudioSinkKind::Ring);
+    if (paced && g_object_class_find_property(G_OBJECT_GET_CLASS(sink_), "sync"))
+        g_object_set(sink_, "sync", !config_.enabled, nullptr);
+
+    if (config_.enabled)
+    {
+        /* Leaky downstream: a full queue drops its oldest buffers rather than blocking the decoder */
+        g_object_set(queue_, "max-size-time", (guint64)config_.max_ms * GST_MSECOND, "max-size-buffers", 0u,
+                     "max-size-bytes", 0u, "leaky", 2, nullptr);
+    }
+    else
+    {
+        /* queue defaults */
+        g_object_set(queue_, "max-size-time", GST_SECOND, "max-size-buffers", 200u, "max-size-bytes", 10485760u, "leaky",
+                     0, nullptr);
+    }
+}
+
+gint64 AudioPlayoutController::Get(Stat stat) const
+{
+    switch (stat)
+    {
+        case LevelUs:
+            return level_stat_.load(std::memory_order_relaxed);
+        case TargetUs:
+            return (gint64)GetConfig().target_ms * 1000;
+        case Underruns:
+            return (gint64)underruns_.load(std::memory_order_relaxed);
+        case Overruns:
+            return (gint64)overruns_.load(std::memory_order_relaxed);
+        case CorrectionPpm:
+            return correction_stat_.load(std::memory_order_relaxed);
+        default:
+            return 0;
+    }
+}
+
+const gchar* AudioPlayoutController::get_sink_factory(AudioSinkKind kind)
+{
+    switch (kind)
+    {
+        case AudioSinkKind::Fake:
+            return "fakesink";
+        case AudioSinkKind::App:
+        case AudioSinkKind::Ring:
+            return "appsink";
+        default:
+#ifdef _WIN32
+            return "wasapi2sink";
+#else
+            return "autoaudiosink";
+#endif
+    }
+}
+
+GstElement* AudioPlayoutController::CreateSink(AudioSinkKind kind)
+{
+    GstElement* sink = gst_element_factory_make(get_sink_factory(kind), nullptr);
+    if (!sink)
+    {
+        Debug::Log(std::string("Failed to create ") + get_sink_factory(kind), Level::Error);
+        return nullptr;
+    }
+
+    switch (kind)
+    {
+        case AudioSinkKind::Device:
+#ifdef _WIN32
+            g_object_set(sink, "low-latency", true, "provide-clock", false, "processing-deadline", 0, nullptr);
+#endif
+            break;
+        case AudioSinkKind::Fake:
+            g_object_set(sink, "sync", TRUE, nullptr);
+            break;
+        case AudioSinkKind::App:
+            g_object_set(sink, "sync", TRUE, "max-buffers", 1u, "drop", TRUE, nullptr);
+            break;
+        case AudioSinkKind::Ring:
+            g_object_set(sink, "sync", FALSE, nullptr);
+            break;
+    }
+    g_object_set_data(G_OBJECT(sink), SINK_KIND, GINT_TO_POINTER((gint)kind + 1));
+    return sink;
+}
+
+bool AudioPlayoutController::IsSinkKind(GstElement* sink, AudioSinkKind kind)
+{
+    return GPOINTER_TO_INT(g_object_get_data(G_OBJECT(sink), SINK_KIND)) == (gint)kind + 1;
+}
+
+void AudioPlayoutController::on_underrun(GstElement* queue, gpointer udata)
+{
+    auto self = static_cast<AudioPlayoutController*>(udata);
+    /* Emitted once empty, also before the first buffer: only count the ones while playing */
+    if (!self->prebuffering_.exchange(true))
+        self->underruns_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioPlayoutController::on_overrun(GstElement* queue, gpointer udata)
+{
+    auto self = static_cast<AudioPlayoutController*>(udata);
+    self->overruns_.fetch_add(1, std::memory_order_relaxed);
+}
+
+GstPadProbeReturn AudioPlayoutController::probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata)
+{
+    auto self = static_cast<AudioPlayoutController*>(udata);
+
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM)
+    {
+        GstEvent* event = GST_PAD_PROBE_INFO_EVENT(info);
+        switch (GST_EVENT_TYPE(event))
+        {
+            case GST_EVENT_CAPS:
+            {
+                GstCaps* caps;
+                gst_event_parse_caps(event, &caps);
+                self->set_caps(caps);
+                break;
+            }
+            case GST_EVENT_FLUSH_STOP:
+            case GST_EVENT_STREAM_START:
+                self->reset();
+                break;
+            default:
+                break;
+        }
+        return GST_PAD_PROBE_OK;
+    }
+
+    const Config config = self->GetConfig();
+    if (!config.enabled)
+        return GST_PAD_PROBE_OK;
+
+    const gint64 target_us = (gint64)config.target_ms * 1000;
+    if (self->prebuffering_.load(std::memory_order_relaxed))
+    {
+        self->wait_prebuffer(pad, target_us);
+        self->prebuffering_ = false;
+    }
+
+    GstBuffer* buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    const gint64 level_us = get_queue_level_us(pad);
+    double ppm = self->update_correction(level_us, target_us, GST_BUFFER_DURATION(buffer));
+    ppm = std::clamp(ppm, -(double)config.max_correction_ppm, (double)config.max_correction_ppm);
+
+    GstBuffer* resampled = self->resample(buffer, ppm);
+    if (resampled != nullptr)
+    {
+        gst_buffer_unref(buffer);
+        GST_PAD_PROBE_INFO_DATA(info) = resampled;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+void AudioPlayoutController::reset()
+{
+    level_us_ = -1.0;
+    integral_ = 0.0;
+    applied_ppm_ = 0.0;
+    prebuffering_ = true;
+    if (resampler_ != nullptr)
+        gst_audio_resampler_reset(resampler_);
+}
+
+void AudioPlayoutController::set_caps(GstCaps* caps)
+{
+    if (resampler_ != nullptr)
+    {
+        gst_audio_resampler_free(resampler_);
+        resampler_ = nullptr;
+    }
+    reset();
+
+    if (!gst_audio_info_from_caps(&info_, caps))
+    {
+        Debug::Log("Cannot parse audio caps, no drift correction", Level::Warning);
+        return;
+    }
+
+    switch (GST_AUDIO_INFO_FORMAT(&info_))
+    {
+        case GST_AUDIO_FORMAT_S16:
+        case GST_AUDIO_FORMAT_S32:
+        case GST_AUDIO_FORMAT_F32:
+        case GST_AUDIO_FORMAT_F64:
+            break;
+        default:
+            Debug::Log(std::string("No drift correction for ") + gst_audio_format_to_string(GST_AUDIO_INFO_FORMAT(&info_)),
+                       Level::Warning);
+            return;
+    }
+    if (GST_AUDIO_INFO_LAYOUT(&info_) != GST_AUDIO_LAYOUT_INTERLEAVED)
+        return;
+
+    const gint rate = GST_AUDIO_INFO_RATE(&info_) * RATE_SCALE;
+    GstStructure* options = gst_structure_new_empty("resampler");
+    gst_audio_resampler_options_set_quality(GST_AUDIO_RESAMPLER_METHOD_KAISER, GST_AUDIO_RESAMPLER_QUALITY_DEFAULT, rate,
+                                            rate, options);
+    gst_structure_set(options, GST_AUDIO_RESAMPLER_OPT_FILTER_MODE, GST_TYPE_AUDIO_RESAMPLER_FILTER_MODE,
+                      GST_AUDIO_RESAMPLER_FILTER_MODE_INTERPOLATED, nullptr);
+    resampler_ = gst_audio_resampler_new(GST_AUDIO_RESAMPLER_METHOD_KAISER, GST_AUDIO_RESAMPLER_FLAG_VARIABLE_RATE,
+                                         GST_AUDIO_INFO_FORMAT(&info_), GST_AUDIO_INFO_CHANNELS(&info_), rate, rate,
+                                         options);
+    gst_structure_free(options);
+}
+
+void AudioPlayoutController::wait_prebuffer(GstPad* pad, gint64 target_us)
+{
+    /* Holds the queue output until enough audio is buffered. The queue task owns this thread, a flush or a state
+     * change sets the pad flushing and ends the wait. */
+    const gint64 deadline = g_get_monotonic_time() + PREBUFFER_TIMEOUT_US;
+    while (get_queue_level_us(pad) < target_us && !GST_PAD_IS_FLUSHING(pad) && g_get_monotonic_time() < deadline)
+        g_usleep(1000);
+}
+
+gint64 AudioPlayoutController::get_queue_level_us(GstPad* pad)
+{
+    guint64 level = 0;
+    GstElement* queue = GST_ELEMENT(gst_pad_get_parent(pad));
+    if (queue != nullptr)
+    {
+        g_object_get(queue, "current-level-time", &level, nullptr);
+        gst_object_unref(queue);
+    }
+    return (gint64)(level / GST_USECOND);
+}
+
+double AudioPlayoutController::update_correction(gint64 level_us, gint64 target_us, GstClockTime duration)
+{
+    level_us_ = level_us_ < 0.0 ? (double)level_us : level_us_ + LEVEL_SMOOTHING * ((double)level_us - level_us_);
+    level_stat_.store((gint64)level_us_, std::memory_order_relaxed);
+
+    /* PI on the smoothed error: P removes the excess over ~10 s, I follows the constant clock drift */
+    const double error_us = level_us_ - (double)target_us;
+    const double error_s = error_us / 1e6;
+    const double seconds = GST_CLOCK_TIME_IS_VALID(duration) ? (double)duration / GST_SECOND : 0.02;
+    integral_ = std::clamp(integral_ + error_s * seconds, -1.0, 1.0);
+    const double proportional = std::abs(error_us) < DEADBAND_US ? 0.0 : PROPORTIONAL_GAIN * error_s;
+    return (proportional + INTEGRAL_GAIN * integral_) * 1e6;
+}
+
+GstBuffer* AudioPlayoutController::resample(GstBuffer* buffer, double ppm)
+{
+    if (resampler_ == nullptr)
+        return nullptr;
+
+    const gint rate = GST_AUDIO_INFO_RATE(&info_) * RATE_SCALE;
+    if (std::abs(ppm - applied_ppm_) >= RATE_STEP_PPM || (ppm == 0.0 && applied_ppm_ != 0.0))
+    {
+        /* Playing faster than received means fewer output frames */
+        const gint out_rate = (gint)std::lround(rate * (1.0 - ppm / 1e6));
+        if (gst_audio_resampler_update(resampler_, rate, out_rate, nullptr))
+        {
+            applied_ppm_ = ppm;
+            correction_stat_.store((gint64)std::lround(ppm), std::memory_order_relaxed);
+        }
+    }
+
+    GstMapInfo in_map;
+    if (!gst_buffer_map(buffer, &in_map, GST_MAP_READ))
+        return nullptr;
+
+    const gsize in_frames = in_map.size / GST_AUDIO_INFO_BPF(&info_);
+    const gsize out_frames = gst_audio_resampler_get_out_frames(resampler_, in_frames);
+    GstBuffer* out = gst_buffer_new_allocate(nullptr, out_frames * GST_AUDIO_INFO_BPF(&info_), nullptr);
+
+    GstMapInfo out_map;
+    gst_buffer_map(out, &out_map, GST_MAP_WRITE);
+    gpointer in_planes[1] = {in_map.data};
+    gpointer out_planes[1] = {out_map.data};
+    gst_audio_resampler_resample(resampler_, in_planes, in_frames, out_planes, out_frames);
+    gst_buffer_unmap(out, &out_map);
+    gst_buffer_unmap(buffer, &in_map);
+
+    gst_buffer_copy_into(out, buffer, GST_BUFFER_COPY_METADATA, 0, -1);
+    GST_BUFFER_DURATION(out) = gst_util_uint64_scale_int(out_frames, GST_SECOND, GST_AUDIO_INFO_RATE(&info_));
+    return out;
+}
@@ -0,0 +1,111 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <atomic>
+#include <gst/audio/audio.h>
+#include <gst/gst.h>
+#include <mutex>
+
+enum class AudioSinkKind
+{
+    Device, // wasapi2sink on Windows, autoaudiosink elsewhere
+    Fake,   // fakesink consuming in real time, for tests without audio device
+    App,    // appsink consuming in real time, samples are dropped
+    Ring    // appsink writing float PCM to the ring Unity reads, paced by the reader
+};
+
+/* Keeps the decoded audio waiting in the branch queue at a target level.
+ * The sink pulls as fast as its device accepts (no clock sync), so the queue level is the playout latency:
+ * playout starts once the target is buffered (again after an underrun), then the audio leaving the queue is
+ * resampled by a few hundred ppm to absorb the drift between the sender clock and the device clock.
+ * The queue is bounded to max_ms, older audio being dropped beyond (overrun).
+ * Attach and Detach follow the audio branch activation, the correction runs on the queue streaming thread. */
+class AudioPlayoutController
+{
+public:
+    struct Config
+    {
+        bool enabled = true;
+        guint target_ms = 40;
+        guint max_ms = 200;
+        float max_correction_ppm = 2000.0f;
+    };
+
+    enum Stat
+    {
+        LevelUs,       // smoothed queue level
+        TargetUs,
+        Underruns,     // queue ran empty while playing
+        Overruns,      // queue full, oldest audio dropped
+        CorrectionPpm, // positive when playing faster than received
+        StatCount
+    };
+
+private:
+    static constexpr double LEVEL_SMOOTHING = 0.05;
+    static constexpr double PROPORTIONAL_GAIN = 0.1; // correction per second of level error
+    static constexpr double INTEGRAL_GAIN = 0.002;
+    static constexpr gint64 DEADBAND_US = 2000;
+    static constexpr gint64 PREBUFFER_TIMEOUT_US = 500000;
+    static constexpr gint64 RATE_SCALE = 100; // resampler rates are scaled for a fine ratio
+    static constexpr double RATE_STEP_PPM = 10.0;
+
+    mutable std::mutex lock_;
+    Config config_;
+    GstElement* queue_ = nullptr;
+    GstElement* sink_ = nullptr;
+    GstPad* pad_ = nullptr; // queue src pad
+    gulong probe_ = 0;
+    gulong underrun_handler_ = 0;
+    gulong overrun_handler_ = 0;
+
+    /* Streaming thread only */
+    GstAudioInfo info_;
+    GstAudioResampler* resampler_ = nullptr;
+    double level_us_ = -1.0;
+    double integral_ = 0.0;
+    double applied_ppm_ = 0.0;
+
+    std::atomic<bool> prebuffering_{true};
+    std::atomic<gint64> level_stat_{0};
+    std::atomic<gint64> correction_stat_{0};
+    std::atomic<guint64> underruns_{0};
+    std::atomic<guint64> overruns_{0};
+
+public:
+    AudioPlayoutController() = default;
+    ~AudioPlayoutController();
+    AudioPlayoutController(const AudioPlayoutController&) = delete;
+    AudioPlayoutController& operator=(const AudioPlayoutController&) = delete;
+
+    // Applied to the attached queue, and on the next Attach
+    void Configure(const Config& config);
+    Config GetConfig() const;
+
+    // queue feeds the sink (through conversion elements). The sink clock sync is turned off while enabled.
+    void Attach(GstElement* queue, GstElement* sink);
+    void Detach();
+
+    gint64 Get(Stat stat) const;
+
+    static GstElement* CreateSink(AudioSinkKind kind);
+    // Sinks are tagged by CreateSink, App and Ring share a factory
+    static bool IsSinkKind(GstElement* sink, AudioSinkKind kind);
+
+private:
+    static GstPadProbeReturn probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata);
+    static void on_underrun(GstElement* queue, gpointer udata);
+    static void on_overrun(GstElement* queue, gpointer udata);
+    static const gchar* get_sink_factory(AudioSinkKind kind);
+    static gint64 get_queue_level_us(GstPad* pad);
+
+    void configure_queue();
+    void reset();
+    void set_caps(GstCaps* caps);
+    void wait_prebuffer(GstPad* pad, gint64 target_us);
+    double update_correction(gint64 level_us, gint64 target_us, GstClockTime duration);
+    GstBuffer* resample(GstBuffer* buffer, double ppm);
+    void detach();
+};
@@ -0,0 +1,136 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "AvSyncMonitor.h"
+#include "PresentTracker.h"
+
+AvSyncMonitor::~AvSyncMonitor() { Detach(); }
+
+void AvSyncMonitor::Attach(GstElement* pipeline, GstElement* audio_sink)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    detach();
+
+    pipeline_ = GST_ELEMENT(gst_object_ref(pipeline));
+    sink_ = GST_ELEMENT(gst_object_ref(audio_sink));
+    pad_ = gst_element_get_static_pad(sink_, "sink");
+    probe_ = gst_pad_add_probe(pad_, GST_PAD_PROBE_TYPE_BUFFER, probe, this, nullptr);
+}
+
+void AvSyncMonitor::Detach()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    detach();
+}
+
+// Call with lock_ held
+void AvSyncMonitor::detach()
+{
+    if (pad_ != nullptr)
+    {
+        gst_pad_remove_probe(pad_, probe_);
+        gst_clear_object(&pad_);
+    }
+    gst_clear_object(&sink_);
+    gst_clear_object(&pipeline_);
+}
+
+void AvSyncMonitor::add(std::atomic<gint64>& smoothed, gint64 value)
+{
+    const gint64 previous = smoothed.load(std::memory_order_relaxed);
+    smoothed.store(previous < 0 ? value : previous + (gint64)(SMOOTHING * (double)(value - previous)),
+                   std::memory_order_relaxed);
+}
+
+GstPadProbeReturn AvSyncMonitor::probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata)
+{
+    auto self = static_cast<AvSyncMonitor*>(udata);
+    GstBuffer* buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    const gint64 latency = PresentTracker::GetCaptureLatency(buffer);
+    if (latency >= 0)
+    {
+        add(self->audio_latency_, latency + self->get_render_wait_us(pad, buffer));
+        self->audio_samples_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+gint64 AvSyncMonitor::get_render_wait_us(GstPad* pad, GstBuffer* buffer)
+{
+    GstElement* pipeline = nullptr;
+    GstElement* sink = nullptr;
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        if (pipeline_ == nullptr)
+            return 0;
+        pipeline = GST_ELEMENT(gst_object_ref(pipeline_));
+        sink = GST_ELEMENT(gst_object_ref(sink_));
+    }
+
+    gint64 wait = 0;
+    gboolean sync = FALSE;
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(sink), "sync"))
+        g_object_get(sink, "sync", &sync, nullptr);
+
+    GstEvent* event = gst_pad_get_sticky_event(pad, GST_EVENT_SEGMENT, 0);
+    if (sync && event != nullptr && GST_BUFFER_PTS_IS_VALID(buffer))
+    {
+        const GstSegment* segment;
+        gst_event_parse_segment(event, &segment);
+        const GstClockTime running_time = gst_segment_to_running_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+        const GstClockTime now = gst_element_get_current_running_time(sink);
+        if (GST_CLOCK_TIME_IS_VALID(running_time) && GST_CLOCK_TIME_IS_VALID(now))
+        {
+            /* Synced sinks render at running time + pipeline latency */
+            const GstClockTime render = running_time + gst_pipeline_get_latency(GST_PIPELINE(pipeline));
+            wait = render > now ? (gint64)((render - now) / GST_USECOND) : 0;
+        }
+    }
+    if (event != nullptr)
+        gst_event_unref(event);
+
+    gst_object_unref(sink);
+    gst_object_unref(pipeline);
+    return wait;
+}
+
+void AvSyncMonitor::OnVideoPresented(gint64 capture_latency_us)
+{
+    if (capture_latency_us < 0)
+        return;
+    add(video_latency_, capture_latency_us);
+    video_samples_.fetch_add(1, std::memory_order_relaxed);
+}
+
+gint64 AvSyncMonitor::Get(Stat stat) const
+{
+    switch (stat)
+    {
+        case AudioLatencyUs:
+            return audio_latency_.load(std::memory_order_relaxed);
+        case VideoLatencyUs:
+            return video_latency_.load(std::memory_order_relaxed);
+        case OffsetUs:
+        {
+            const gint64 audio = audio_latency_.load(std::memory_order_relaxed);
+            const gint64 video = video_latency_.load(std::memory_order_relaxed);
+            return audio < 0 || video < 0 ? 0 : video - audio;
+        }
+        case AudioSamples:
+            return (gint64)audio_samples_.load(std::memory_order_relaxed);
+        case VideoSamples:
+            return (gint64)video_samples_.load(std::memory_order_relaxed);
+        default:
+            return 0;
+    }
+}
+
+void AvSyncMonitor::Reset()
+{
+    audio_latency_ = -1;
+    video_latency_ = -1;
+    audio_samples_ = 0;
+    video_samples_ = 0;
+}
@@ -0,0 +1,69 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <atomic>
+#include <gst/gst.h>
+#include <mutex>
+
+enum class AvSyncMode
+{
+    LowLatency, // sinks render as soon as possible, audio latency held by the AudioPlayoutController
+    Synced      // sinks render on the pipeline clock, rtpbin aligns the streams with the RTCP sender reports
+};
+
+/* Measures the A/V offset from the sender capture time of what is rendered.
+ * The audio capture latency is taken at the audio sink input, plus the wait for its clock time when the sink syncs
+ * (the device buffer is not counted), the video one when a frame is drawn. Both need the NTP reference timestamp meta
+ * and are smoothed. Attach and Detach follow the audio branch activation. */
+class AvSyncMonitor
+{
+public:
+    enum Stat
+    {
+        AudioLatencyUs, // capture to playout
+        VideoLatencyUs, // capture to draw
+        OffsetUs,       // video minus audio latency, positive when the video is late
+        AudioSamples,
+        VideoSamples,
+        StatCount
+    };
+
+private:
+    static constexpr double SMOOTHING = 0.05;
+
+    std::mutex lock_;
+    GstElement* pipeline_ = nullptr;
+    GstElement* sink_ = nullptr;
+    GstPad* pad_ = nullptr; // audio sink pad
+    gulong probe_ = 0;
+
+    std::atomic<gint64> audio_latency_{-1};
+    std::atomic<gint64> video_latency_{-1};
+    std::atomic<guint64> audio_samples_{0};
+    std::atomic<guint64> video_samples_{0};
+
+public:
+    AvSyncMonitor() = default;
+    ~AvSyncMonitor();
+    AvSyncMonitor(const AvSyncMonitor&) = delete;
+    AvSyncMonitor& operator=(const AvSyncMonitor&) = delete;
+
+    // pipeline gives the latency the synced sinks add
+    void Attach(GstElement* pipeline, GstElement* audio_sink);
+    void Detach();
+
+    // Render thread, capture latency of a drawn frame (-1 if unknown)
+    void OnVideoPresented(gint64 capture_latency_us);
+    // Latencies are -1 until measured, the offset 0 until both are
+    gint64 Get(Stat stat) const;
+    void Reset();
+
+private:
+    static GstPadProbeReturn probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata);
+    static void add(std::atomic<gint64>& smoothed, gint64 value);
+    // Time left before the sink renders the buffer, 0 if it does not sync
+    gint64 get_render_wait_us(GstPad* pad, GstBuffer* buffer);
+    void detach();
+};
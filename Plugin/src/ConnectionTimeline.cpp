@@ -0,0 +1,46 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "ConnectionTimeline.h"
+
+const char* const ConnectionTimeline::NAMES[MilestoneCount] = {
+    "create_pipeline", "signaller_connected", "webrtcbin_ready", "video_pad_left", "video_pad_right", "audio_pad",
+    "first_sample_left", "first_sample_right", "first_draw_left", "first_draw_right", "first_audio_buffer"};
+
+void ConnectionTimeline::Reset()
+{
+    for (auto& time : times_)
+        time.store(0, std::memory_order_relaxed);
+    Mark(CreatePipeline);
+}
+
+void ConnectionTimeline::Mark(Milestone milestone)
+{
+    /* Cheap enough for the streaming threads once the milestone is set */
+    if (IsMarked(milestone))
+        return;
+
+    gint64 expected = 0;
+    times_[milestone].compare_exchange_strong(expected, g_get_monotonic_time(), std::memory_order_relaxed);
+}
+
+gint64 ConnectionTimeline::GetElapsed(Milestone milestone) const
+{
+    const gint64 start = times_[CreatePipeline].load(std::memory_order_relaxed);
+    const gint64 time = times_[milestone].load(std::memory_order_relaxed);
+    if (start == 0 || time == 0)
+        return -1;
+    return time - start;
+}
+
+std::string ConnectionTimeline::Report() const
+{
+    std::string report = "Connection timeline (us):";
+    for (int i = 0; i < MilestoneCount; i++)
+    {
+        const gint64 elapsed = GetElapsed(static_cast<Milestone>(i));
+        report += std::string(" ") + NAMES[i] + "=" + (elapsed < 0 ? "n/a" : std::to_string(elapsed));
+    }
+    return report;
+}
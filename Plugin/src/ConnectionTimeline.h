@@ -0,0 +1,45 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <atomic>
+#include <gst/gst.h>
+#include <string>
+
+/* Monotonic timestamps of the connection milestones, to find where setup time goes.
+ * Each milestone keeps its first occurrence until the next Reset(). Thread safe. */
+class ConnectionTimeline
+{
+public:
+    // Order of the values returned by GetConnectionTimeline, do not reorder
+    enum Milestone
+    {
+        CreatePipeline,
+        SignallerConnected,
+        WebrtcbinReady,
+        VideoPadAddedLeft,
+        VideoPadAddedRight,
+        AudioPadAdded,
+        FirstSampleLeft,
+        FirstSampleRight,
+        FirstDrawLeft,
+        FirstDrawRight,
+        FirstAudioBuffer,
+        MilestoneCount
+    };
+
+private:
+    static const char* const NAMES[MilestoneCount];
+    std::atomic<gint64> times_[MilestoneCount] = {};
+
+public:
+    // Clears all milestones and marks CreatePipeline
+    void Reset();
+    void Mark(Milestone milestone);
+    bool IsMarked(Milestone milestone) const { return times_[milestone].load(std::memory_order_relaxed) != 0; }
+
+    // Microseconds since CreatePipeline, -1 if the milestone was not reached
+    gint64 GetElapsed(Milestone milestone) const;
+    std::string Report() const;
+};
@@ -0,0 +1,104 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <functional>
+#include <gst/video/video.h>
+#include <list>
+
+/* Small LRU of video converters keyed on (input info, output info, backend, creation options).
+ * Switching back to a resolution seen recently reuses its converter instead of building
+ * a new one (shader compilation for D3D11). Not thread safe, owned by the render thread. */
+template <typename Converter>
+class ConverterCache
+{
+public:
+    using Deleter = void (*)(Converter*);
+
+private:
+    struct Entry
+    {
+        GstVideoInfo in_info;
+        GstVideoInfo out_info;
+        int backend;
+        GstStructure* options;
+        Converter* conv;
+    };
+
+    Deleter deleter_;
+    size_t capacity_;
+    std::list<Entry> entries_; // most recently used first
+
+    static bool matches(const Entry& entry, const GstVideoInfo* in_info, const GstVideoInfo* out_info, int backend,
+                        const GstStructure* options)
+    {
+        if (entry.backend != backend || !gst_video_info_is_equal(&entry.in_info, in_info) ||
+            !gst_video_info_is_equal(&entry.out_info, out_info))
+            return false;
+        if (entry.options == nullptr || options == nullptr)
+            return entry.options == options;
+        return gst_structure_is_equal(entry.options, options);
+    }
+
+    void destroy(Entry& entry)
+    {
+        deleter_(entry.conv);
+        if (entry.options)
+            gst_structure_free(entry.options);
+    }
+
+public:
+    ConverterCache(Deleter deleter, size_t capacity = 4) : deleter_(deleter), capacity_(capacity) {}
+    ~ConverterCache() { Clear(); }
+    ConverterCache(const ConverterCache&) = delete;
+    ConverterCache& operator=(const ConverterCache&) = delete;
+
+    // Returns the cached converter, or the one built by create (may return nullptr). The cache keeps ownership.
+    // options are the settings the converter was created with, when they cannot be changed afterwards (copied).
+    Converter* Acquire(const GstVideoInfo* in_info, const GstVideoInfo* out_info, int backend, const GstStructure* options,
+                       const std::function<Converter*()>& create)
+    {
+        for (auto it = entries_.begin(); it != entries_.end(); ++it)
+        {
+            if (matches(*it, in_info, out_info, backend, options))
+            {
+                entries_.splice(entries_.begin(), entries_, it);
+                return entries_.front().conv;
+            }
+        }
+
+        Converter* conv = create();
+        if (conv == nullptr)
+            return nullptr;
+
+        entries_.push_front({*in_info, *out_info, backend, options ? gst_structure_copy(options) : nullptr, conv});
+        while (entries_.size() > capacity_)
+        {
+            destroy(entries_.back());
+            entries_.pop_back();
+        }
+        return conv;
+    }
+
+    bool Contains(const GstVideoInfo* in_info, const GstVideoInfo* out_info, int backend,
+                  const GstStructure* options = nullptr) const
+    {
+        for (const auto& entry : entries_)
+        {
+            if (matches(entry, in_info, out_info, backend, options))
+                return true;
+        }
+        return false;
+    }
+
+    void SetCapacity(size_t capacity) { capacity_ = capacity; }
+    size_t GetCapacity() const { return capacity_; }
+
+    void Clear()
+    {
+        for (auto& entry : entries_)
+            destroy(entry);
+        entries_.clear();
+    }
+};
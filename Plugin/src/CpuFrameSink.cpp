@@ -0,0 +1,463 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "CpuFrameSink.h"
+#include "DebugLog.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+CpuFrameSink::CpuFrameSink() : _pool(std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u))
+{
+    Debug::Log(std::string("YUV to RGBA kernels: ") + YuvToRgba::GetIsaName(YuvToRgba::GetIsa()));
+}
+
+CpuFrameSink::~CpuFrameSink()
+{
+    for (auto& target : _targets)
+        release_target(target);
+    release_target(_stereo);
+}
+
+void* CpuFrameSink::CreateTexture(unsigned int width, unsigned int height, int stream)
+{
+    if (!IsValidStream(stream))
+    {
+        Debug::Log("Invalid stream " + std::to_string(stream), Level::Error);
+        return nullptr;
+    }
+
+    std::unique_ptr<Target> target = std::make_unique<Target>();
+    allocate_ring(target.get(), width, height);
+
+    void* ptr = target->pixels[0].load();
+    release_target(_targets[stream]);
+    _targets[stream] = std::move(target);
+    publish_target_size(stream, width, height);
+    return ptr;
+}
+
+void CpuFrameSink::allocate_ring(Target* target, unsigned int width, unsigned int height)
+{
+    gst_video_info_set_format(&target->out_info, GST_VIDEO_FORMAT_RGBA, width, height);
+
+    /* 64 bytes aligned so that the conversion can use aligned vector stores */
+    GstAllocationParams params;
+    gst_allocation_params_init(&params);
+    params.align = 63;
+
+    for (unsigned int i = 0; i < RING_SIZE; i++)
+    {
+        /* The previous ring may still be read by Unity until it picks the new pointer */
+        gst_clear_buffer(&target->retired[i]);
+        target->retired[i] = target->ring[i];
+
+        target->ring[i] = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&target->out_info), &params);
+        g_assert(target->ring[i]);
+
+        /* System memory does not move, keep the pointer for the Unity side */
+        GstMapInfo map;
+        gst_buffer_map(target->ring[i], &map, GST_MAP_WRITE);
+        memset(map.data, 0, map.size);
+        target->pixels[i].store(map.data, std::memory_order_relaxed);
+        gst_buffer_unmap(target->ring[i], &map);
+    }
+    target->front.store(0, std::memory_order_release);
+}
+
+void* CpuFrameSink::CreateStereoTexture(unsigned int eye_width, unsigned int eye_height, StereoLayout layout)
+{
+    std::unique_ptr<Target> stereo = std::make_unique<Target>();
+    stereo->layout = layout;
+    if (layout == StereoLayout::SideBySide)
+        allocate_ring(stereo.get(), eye_width * 2, eye_height);
+    else
+        allocate_ring(stereo.get(), eye_width, eye_height * 2);
+
+    for (int eye = 0; eye < 2; eye++)
+    {
+        std::unique_ptr<Target> target = std::make_unique<Target>();
+        target->eye = eye;
+        set_eye_view(&target->out_info, stereo.get(), eye, eye_width, eye_height);
+        release_target(_targets[eye]);
+        _targets[eye] = std::move(target);
+        publish_target_size(eye, eye_width, eye_height);
+    }
+
+    void* ptr = stereo->pixels[0].load();
+    release_target(_stereo);
+    _stereo = std::move(stereo);
+    return ptr;
+}
+
+void CpuFrameSink::set_eye_view(GstVideoInfo* info, const Target* stereo, int eye, unsigned int width,
+                                unsigned int height)
+{
+    /* Same rows as the packed buffer, starting at the eye half (side by side) or slice (array) */
+    gst_video_info_set_format(info, GST_VIDEO_FORMAT_RGBA, width, height);
+    const gint stride = GST_VIDEO_INFO_PLANE_STRIDE(&stereo->out_info, 0);
+    GST_VIDEO_INFO_PLANE_STRIDE(info, 0) = stride;
+    if (stereo->layout == StereoLayout::SideBySide)
+        GST_VIDEO_INFO_PLANE_OFFSET(info, 0) = eye * width * 4;
+    else
+        GST_VIDEO_INFO_PLANE_OFFSET(info, 0) = (gsize)eye * stride * height;
+    GST_VIDEO_INFO_SIZE(info) = GST_VIDEO_INFO_SIZE(&stereo->out_info);
+}
+
+void* CpuFrameSink::GetStereoTexturePtr()
+{
+    if (_stereo == nullptr)
+        return nullptr;
+    return _stereo->pixels[_stereo->front.load(std::memory_order_acquire)].load(std::memory_order_relaxed);
+}
+
+void* CpuFrameSink::GetTexturePtr(int stream)
+{
+    Target* target = get_target(stream);
+    if (target == nullptr)
+        return nullptr;
+    return target->pixels[target->front.load(std::memory_order_acquire)].load(std::memory_order_relaxed);
+}
+
+void CpuFrameSink::ReleaseTexture(void* texture)
+{
+    if (_stereo != nullptr)
+    {
+        for (const auto& pixels : _stereo->pixels)
+        {
+            if (pixels.load() == texture)
+            {
+                release_target(_stereo);
+                for (auto& target : _targets)
+                {
+                    if (target != nullptr && target->eye >= 0)
+                        release_target(target);
+                }
+                return;
+            }
+        }
+    }
+
+    for (auto& target : _targets)
+    {
+        if (target == nullptr)
+            continue;
+        for (const auto& pixels : target->pixels)
+        {
+            if (pixels.load() == texture)
+            {
+                release_target(target);
+                return;
+            }
+        }
+    }
+}
+
+bool CpuFrameSink::Draw(int stream, GstSample* sample) { return DrawBatch(&stream, &sample, 1) != 0; }
+
+unsigned int CpuFrameSink::DrawBatch(const int* streams, GstSample* const* samples, int count)
+{
+    _pending.resize(count);
+    _slices.clear();
+
+    int prepared = 0;
+    for (int i = 0; i < count; i++)
+    {
+        Pending* pending = &_pending[prepared];
+        if (!prepare(streams[i], samples[i], pending))
+            continue;
+
+        if (pending->target->direct)
+        {
+            /* Even rows so that slices do not share chroma rows */
+            const int height = GST_VIDEO_FRAME_HEIGHT(&pending->out_frame);
+            const int slices = std::min<int>(_pool.GetThreadCount(), (height + 1) / 2);
+            const int rows = (((height + slices - 1) / slices) + 1) & ~1;
+            for (int first = 0; first < height; first += rows)
+                _slices.push_back({prepared, first, std::min(first + rows, height)});
+        }
+        else
+        {
+            _slices.push_back({prepared, 0, -1});
+        }
+        prepared++;
+    }
+
+    _pool.Run(static_cast<int>(_slices.size()),
+              [this](int i)
+              {
+                  const Slice& slice = _slices[i];
+                  convert(&_pending[slice.pending], slice.first_row, slice.last_row);
+              });
+
+    /* Every slice is done, publish the new slots */
+    bool eyes[2] = {false, false};
+    unsigned int drawn = 0;
+    for (int i = 0; i < prepared; i++)
+    {
+        Pending* pending = &_pending[i];
+        gst_video_frame_unmap(&pending->out_frame);
+        gst_video_frame_unmap(&pending->in_frame);
+        drawn |= 1u << pending->stream;
+        if (pending->target->eye >= 0)
+            eyes[pending->target->eye] = true;
+        else
+            pending->target->front.store(pending->next, std::memory_order_release);
+    }
+    if (eyes[0] || eyes[1])
+        publish_stereo(eyes);
+    return drawn;
+}
+
+void CpuFrameSink::publish_stereo(const bool drawn[2])
+{
+    const unsigned int front = _stereo->front.load(std::memory_order_relaxed);
+    const unsigned int next = (front + 1) % RING_SIZE;
+    for (int eye = 0; eye < 2; eye++)
+    {
+        Target* target = get_target(eye);
+        if (drawn[eye] || target == nullptr || target->eye != eye)
+            continue;
+
+        GstVideoFrame previous, frame;
+        if (!gst_video_frame_map(&previous, &target->out_info, _stereo->ring[front], GST_MAP_READ))
+            continue;
+        if (gst_video_frame_map(&frame, &target->out_info, _stereo->ring[next], GST_MAP_WRITE))
+        {
+            gst_video_frame_copy(&frame, &previous);
+            gst_video_frame_unmap(&frame);
+        }
+        gst_video_frame_unmap(&previous);
+    }
+    _stereo->front.store(next, std::memory_order_release);
+}
+
+bool CpuFrameSink::prepare(int stream, GstSample* sample, Pending* pending)
+{
+    Target* target = get_target(stream);
+    if (target == nullptr)
+    {
+        Debug::Log("target is null", Level::Warning);
+        return false;
+    }
+
+    GstBuffer* buf = gst_sample_get_buffer(sample);
+    GstCaps* caps = gst_sample_get_caps(sample);
+
+    OutputConfig config;
+    if (take_output_config(stream, &config))
+        apply_output_config(target, stream, config);
+
+    /* Caps updated, pick the matching converter */
+    if (!target->last_caps || !gst_caps_is_equal(target->last_caps, caps))
+        update_converter(target, caps);
+
+    if (!target->conv && !target->direct)
+        return false;
+
+    /* Write into the slot after the published one, then publish it. Eyes share the slot of the stereo target. */
+    Target* owner = target->eye >= 0 ? _stereo.get() : target;
+    if (owner == nullptr)
+        return false;
+    pending->target = target;
+    pending->stream = stream;
+    pending->next = (owner->front.load(std::memory_order_relaxed) + 1) % RING_SIZE;
+
+    if (!gst_video_frame_map(&pending->in_frame, &target->in_info, buf, GST_MAP_READ))
+    {
+        Debug::Log("Cannot map input frame", Level::Error);
+        return false;
+    }
+    if (!gst_video_frame_map(&pending->out_frame, &target->out_info, owner->ring[pending->next], GST_MAP_WRITE))
+    {
+        Debug::Log("Cannot map output frame", Level::Error);
+        gst_video_frame_unmap(&pending->in_frame);
+        return false;
+    }
+    return true;
+}
+
+void CpuFrameSink::convert(Pending* pending, int first_row, int last_row)
+{
+    const Target* target = pending->target;
+    if (last_row < 0)
+    {
+        gst_video_converter_frame(target->conv, &pending->in_frame, &pending->out_frame);
+        return;
+    }
+
+    const GstVideoFrame* in_frame = &pending->in_frame;
+    const uint8_t* planes[3] = {nullptr};
+    int strides[3] = {0};
+    for (guint i = 0; i < GST_VIDEO_FRAME_N_PLANES(in_frame) && i < 3; i++)
+    {
+        planes[i] = static_cast<const uint8_t*>(GST_VIDEO_FRAME_PLANE_DATA(in_frame, i));
+        strides[i] = GST_VIDEO_FRAME_PLANE_STRIDE(in_frame, i);
+    }
+
+    YuvToRgba::Convert(target->direct_format, planes, strides,
+                       static_cast<uint8_t*>(GST_VIDEO_FRAME_PLANE_DATA(&pending->out_frame, 0)),
+                       GST_VIDEO_FRAME_PLANE_STRIDE(&pending->out_frame, 0), GST_VIDEO_FRAME_WIDTH(&pending->out_frame),
+                       first_row, last_row, target->direct_coefs);
+}
+
+void CpuFrameSink::apply_output_config(Target* target, int stream, const OutputConfig& config)
+{
+    const unsigned int width = config.width ? config.width : GST_VIDEO_INFO_WIDTH(&target->out_info);
+    const unsigned int height = config.height ? config.height : GST_VIDEO_INFO_HEIGHT(&target->out_info);
+    const bool resize = width != (unsigned int)GST_VIDEO_INFO_WIDTH(&target->out_info) ||
+                        height != (unsigned int)GST_VIDEO_INFO_HEIGHT(&target->out_info);
+    if (resize && target->eye >= 0)
+    {
+        Debug::Log("Eyes of the stereo target keep their size", Level::Warning);
+    }
+    else if (resize)
+    {
+        Debug::Log("Resize target to " + std::to_string(width) + "x" + std::to_string(height));
+        allocate_ring(target, width, height);
+        publish_target_size(stream, width, height);
+    }
+    target->config = config;
+
+    /* Pick the converter matching the new output on this draw */
+    target->conv = nullptr;
+    target->direct = false;
+    gst_clear_caps(&target->last_caps);
+}
+
+GstStructure* CpuFrameSink::converter_options(const OutputConfig& config, const GstVideoInfo* in_info,
+                                              const GstVideoInfo* out_info)
+{
+    GstVideoRectangle src, dst;
+    compute_rectangles(config, in_info, out_info, &src, &dst);
+
+    /* Borders are filled in black by default */
+    return gst_structure_new("GstVideoConverter", GST_VIDEO_CONVERTER_OPT_SRC_X, G_TYPE_INT, src.x,
+                             GST_VIDEO_CONVERTER_OPT_SRC_Y, G_TYPE_INT, src.y, GST_VIDEO_CONVERTER_OPT_SRC_WIDTH, G_TYPE_INT,
+                             src.w, GST_VIDEO_CONVERTER_OPT_SRC_HEIGHT, G_TYPE_INT, src.h, GST_VIDEO_CONVERTER_OPT_DEST_X,
+                             G_TYPE_INT, dst.x, GST_VIDEO_CONVERTER_OPT_DEST_Y, G_TYPE_INT, dst.y,
+                             GST_VIDEO_CONVERTER_OPT_DEST_WIDTH, G_TYPE_INT, dst.w, GST_VIDEO_CONVERTER_OPT_DEST_HEIGHT,
+                             G_TYPE_INT, dst.h, nullptr);
+}
+
+bool CpuFrameSink::get_direct_conversion(const Target* target, YuvToRgba::Format* format,
+                                         YuvToRgba::Coefficients* coefs)
+{
+    const GstVideoInfo* in_info = &target->in_info;
+    switch (GST_VIDEO_INFO_FORMAT(in_info))
+    {
+        case GST_VIDEO_FORMAT_NV12:
+            *format = YuvToRgba::Format::NV12;
+            break;
+        case GST_VIDEO_FORMAT_I420:
+            *format = YuvToRgba::Format::I420;
+            break;
+        default:
+            return false;
+    }
+
+    /* No scaling, crop or borders */
+    GstVideoRectangle src, dst;
+    compute_rectangles(target->config, in_info, &target->out_info, &src, &dst);
+    if (src.x != 0 || src.y != 0 || src.w != GST_VIDEO_INFO_WIDTH(in_info) || src.h != GST_VIDEO_INFO_HEIGHT(in_info) ||
+        dst.x != 0 || dst.y != 0 || dst.w != GST_VIDEO_INFO_WIDTH(&target->out_info) ||
+        dst.h != GST_VIDEO_INFO_HEIGHT(&target->out_info) || src.w != dst.w || src.h != dst.h)
+        return false;
+
+    gdouble kr, kb;
+    if (!gst_video_color_matrix_get_Kr_Kb(in_info->colorimetry.matrix, &kr, &kb))
+        return false;
+
+    *coefs = YuvToRgba::GetCoefficients(kr, kb, in_info->colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255);
+    return true;
+}
+
+void CpuFrameSink::update_converter(Target* target, GstCaps* caps)
+{
+    target->conv = nullptr;
+    target->direct = false;
+    gst_clear_caps(&target->last_caps);
+
+    if (!gst_video_info_from_caps(&target->in_info, caps))
+    {
+        Debug::Log("Cannot parse sample caps", Level::Error);
+        return;
+    }
+
+    /* The common case of a decoded frame shown at its own size skips GstVideoConverter */
+    if (get_direct_conversion(target, &target->direct_format, &target->direct_coefs))
+    {
+        target->direct = true;
+        gst_caps_replace(&target->last_caps, caps);
+        return;
+    }
+
+    /* Crop and destination rectangles are fixed at creation, they are part of the cache key */
+    auto acquire = [this, target](const GstVideoInfo* in_info)
+    {
+        GstStructure* options = converter_options(target->config, in_info, &target->out_info);
+        GstVideoConverter* conv = target->converters.Acquire(
+            in_info, &target->out_info, 0, options,
+            [&]()
+            {
+                Debug::Log("Create new converter " + std::to_string(GST_VIDEO_INFO_WIDTH(in_info)) + "x" +
+                           std::to_string(GST_VIDEO_INFO_HEIGHT(in_info)));
+                return gst_video_converter_new(in_info, &target->out_info, gst_structure_copy(options));
+            });
+        gst_structure_free(options);
+        return conv;
+    };
+
+    /* Build the converters of the other known resolutions now, so that switching to them costs nothing */
+    const std::vector<GstVideoInfo> prewarm = get_prewarm_infos(&target->in_info);
+    target->converters.SetCapacity(std::max<size_t>(target->converters.GetCapacity(), prewarm.size() + 1));
+    for (const auto& info : prewarm)
+        acquire(&info);
+
+    target->conv = acquire(&target->in_info);
+    if (!target->conv)
+    {
+        Debug::Log("Cannot create video converter", Level::Error);
+        return;
+    }
+    gst_caps_replace(&target->last_caps, caps);
+}
+
+void CpuFrameSink::SetThreadCount(unsigned int count)
+{
+    _pool.SetThreadCount(count);
+    Debug::Log("Conversion threads: " + std::to_string(_pool.GetThreadCount()));
+}
+
+void CpuFrameSink::Flush()
+{
+    /* Converters stay cached for the next connection */
+    for (auto& target : _targets)
+    {
+        if (target == nullptr)
+            continue;
+        gst_clear_caps(&target->last_caps);
+        target->conv = nullptr;
+        target->direct = false;
+    }
+}
+
+GstCaps* CpuFrameSink::get_appsink_caps()
+{
+    /* Any system memory layout, conversion to RGBA happens in Draw */
+    return gst_caps_from_string("video/x-raw");
+}
+
+void CpuFrameSink::release_target(std::unique_ptr<Target>& target)
+{
+    if (target == nullptr)
+        return;
+
+    for (auto& buffer : target->ring)
+        gst_clear_buffer(&buffer);
+    for (auto& buffer : target->retired)
+        gst_clear_buffer(&buffer);
+    gst_clear_caps(&target->last_caps);
+    target = nullptr;
+}
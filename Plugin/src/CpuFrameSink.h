@@ -0,0 +1,109 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include "ConverterCache.h"
+#include "FrameSink.h"
+#include "WorkerPool.h"
+#include "YuvToRgba.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/* Software decode into system memory.
+ * Each eye owns a ring of RGBA buffers: Draw converts into the next slot and then
+ * publishes it, so the pointer returned by GetTexturePtr stays valid for RING_SIZE - 1 draws.
+ * A resize replaces the ring, the previous one is kept until the next resize.
+ * DrawBatch converts the streams concurrently on a worker pool, direct conversions being also split in row slices.
+ * A stereo target packs both eyes in each ring buffer, the eyes then write through a view of it. */
+class CpuFrameSink : public FrameSink
+{
+public:
+    static constexpr unsigned int RING_SIZE = 3;
+
+private:
+    struct Target
+    {
+        GstBuffer* ring[RING_SIZE] = {nullptr};
+        GstBuffer* retired[RING_SIZE] = {nullptr};
+        std::atomic<guint8*> pixels[RING_SIZE] = {};
+        std::atomic<unsigned int> front{0};
+        /* Everything below is only touched by the render thread */
+        int eye = -1;                                     // draws into the ring of the stereo target
+        StereoLayout layout = StereoLayout::SideBySide; // of the stereo target
+        GstVideoInfo out_info;
+        OutputConfig config;
+        GstCaps* last_caps = nullptr;
+        GstVideoInfo in_info;
+        GstVideoConverter* conv = nullptr; // owned by converters
+        /* Set when the frame maps 1:1 onto the target, conv is then unused */
+        bool direct = false;
+        YuvToRgba::Format direct_format;
+        YuvToRgba::Coefficients direct_coefs;
+        ConverterCache<GstVideoConverter> converters{gst_video_converter_free};
+    };
+
+    std::unique_ptr<Target> _targets[MAX_STREAMS];
+    std::unique_ptr<Target> _stereo;
+
+    /* A frame mapped for conversion by DrawBatch */
+    struct Pending
+    {
+        Target* target;
+        int stream;
+        unsigned int next;
+        GstVideoFrame in_frame;
+        GstVideoFrame out_frame;
+    };
+    struct Slice
+    {
+        int pending;
+        int first_row;
+        int last_row; // -1 for a whole frame through GstVideoConverter
+    };
+
+    WorkerPool _pool;
+    /* Reused by each DrawBatch */
+    std::vector<Pending> _pending;
+    std::vector<Slice> _slices;
+
+public:
+    CpuFrameSink();
+    ~CpuFrameSink() override;
+
+    const char* GetName() const override { return "cpu"; }
+
+    void CreateDevice() override {}
+    void* CreateTexture(unsigned int width, unsigned int height, int stream) override;
+    void* GetTexturePtr(int stream) override;
+    void ReleaseTexture(void* texture) override;
+    void* CreateStereoTexture(unsigned int eye_width, unsigned int eye_height, StereoLayout layout) override;
+    void* GetStereoTexturePtr() override;
+
+    bool Draw(int stream, GstSample* sample) override;
+    unsigned int DrawBatch(const int* streams, GstSample* const* samples, int count) override;
+    void Flush() override;
+    void SetThreadCount(unsigned int count) override;
+
+    bool AcceptsDecoder(DecoderKind kind) const override { return kind != DecoderKind::D3D11; }
+    GstElement* add_video_convert(GstElement* pipeline) override { return nullptr; }
+    GstCaps* get_appsink_caps() override;
+
+private:
+    Target* get_target(int stream) { return IsValidStream(stream) ? _targets[stream].get() : nullptr; }
+    static void allocate_ring(Target* target, unsigned int width, unsigned int height);
+    // Layout of one eye inside the buffers of the stereo target
+    static void set_eye_view(GstVideoInfo* info, const Target* stereo, int eye, unsigned int width, unsigned int height);
+    // Publishes the next slot of the stereo target, completed with the previous frame of an eye not drawn
+    void publish_stereo(const bool drawn[2]);
+    void apply_output_config(Target* target, int stream, const OutputConfig& config);
+    void update_converter(Target* target, GstCaps* caps);
+    static bool get_direct_conversion(const Target* target, YuvToRgba::Format* format, YuvToRgba::Coefficients* coefs);
+    // Maps the sample and the next ring slot of the stream, false if there is nothing to convert
+    bool prepare(int stream, GstSample* sample, Pending* pending);
+    static void convert(Pending* pending, int first_row, int last_row);
+    static GstStructure* converter_options(const OutputConfig& config, const GstVideoInfo* in_info,
+                                           const GstVideoInfo* out_info);
+    static void release_target(std::unique_ptr<Target>& target);
+};
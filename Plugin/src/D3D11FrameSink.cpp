@@ -0,0 +1,505 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "D3D11FrameSink.h"
+#include "DebugLog.h"
+
+#include <algorithm>
+#include <d3d11_1.h>
+#include <d3d11sdklayers.h>
+#include <dxgi1_2.h>
+#include <dxgiformat.h>
+
+#include "Unity/IUnityGraphicsD3D11.h"
+using namespace Microsoft::WRL;
+
+D3D11FrameSink::D3D11FrameSink(IUnityInterfaces* s_UnityInterfaces) : _s_UnityInterfaces(s_UnityInterfaces) {}
+
+D3D11FrameSink::~D3D11FrameSink()
+{
+    for (auto& target : _targets)
+        release_target(target);
+    Flush();
+    gst_clear_object(&_device);
+}
+
+void D3D11FrameSink::CreateDevice()
+{
+    if (_device == nullptr)
+    {
+        /* Find adapter LUID of render device, then create our device with the same
+         * adapter */
+        ComPtr<IDXGIDevice> dxgi_device;
+        auto hr = _s_UnityInterfaces->Get<IUnityGraphicsD3D11>()->GetDevice()->QueryInterface(IID_PPV_ARGS(&dxgi_device));
+        g_assert(SUCCEEDED(hr));
+
+        ComPtr<IDXGIAdapter> adapter;
+        hr = dxgi_device->GetAdapter(&adapter);
+        g_assert(SUCCEEDED(hr));
+
+        DXGI_ADAPTER_DESC adapter_desc;
+        hr = adapter->GetDesc(&adapter_desc);
+        g_assert(SUCCEEDED(hr));
+
+        auto luid = gst_d3d11_luid_to_int64(&adapter_desc.AdapterLuid);
+
+        /* This device will be used by our pipeline */
+        _device = gst_d3d11_device_new_for_adapter_luid(
+            luid, D3D11_CREATE_DEVICE_BGRA_SUPPORT /* | D3D11_CREATE_DEVICE_DEBUG*/);
+        g_assert(_device);
+    }
+    else
+    {
+        Debug::Log("Device already created", Level::Warning);
+    }
+}
+
+// Call only on plugin thread
+// Creates the underlying D3D11 texture using the provided unity device.
+// This texture can then be turned into a proper Unity texture on the
+// managed side using Texture2D.CreateExternalTexture()
+void* D3D11FrameSink::CreateTexture(unsigned int width, unsigned int height, int stream)
+{
+    if (!IsValidStream(stream))
+    {
+        Debug::Log("Invalid stream " + std::to_string(stream), Level::Error);
+        return nullptr;
+    }
+
+    std::unique_ptr<Target> target = std::make_unique<Target>();
+    allocate_surface(target.get(), width, height);
+
+    void* texture = target->surface.texture;
+    release_target(_targets[stream]);
+    _targets[stream] = std::move(target);
+    publish_target_size(stream, width, height);
+    return texture;
+}
+
+void* D3D11FrameSink::CreateStereoTexture(unsigned int eye_width, unsigned int eye_height, StereoLayout layout)
+{
+    std::unique_ptr<Stereo> stereo = std::make_unique<Stereo>();
+    stereo->layout = layout;
+    stereo->eye_width = eye_width;
+    stereo->eye_height = eye_height;
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = layout == StereoLayout::SideBySide ? eye_width * 2 : eye_width;
+    desc.Height = eye_height;
+    desc.MipLevels = 1;
+    desc.ArraySize = layout == StereoLayout::Array ? 2 : 1;
+    desc.Format = DXGI_FORMAT::DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX | D3D11_RESOURCE_MISC_SHARED_NTHANDLE;
+
+    stereo->texture = create_shared_texture(desc, &stereo->keyed_mutex, &stereo->gst_texture);
+    HRESULT hr = stereo->gst_texture.As(&stereo->gst_keyed_mutex);
+    g_assert(SUCCEEDED(hr));
+
+    for (int eye = 0; eye < 2; eye++)
+    {
+        std::unique_ptr<Target> target = std::make_unique<Target>();
+        target->eye = eye;
+        allocate_eye_surface(target.get(), eye_width, eye_height);
+        release_target(_targets[eye]);
+        _targets[eye] = std::move(target);
+        publish_target_size(eye, eye_width, eye_height);
+    }
+
+    _stereo = std::move(stereo);
+    return _stereo->texture;
+}
+
+void* D3D11FrameSink::GetStereoTexturePtr() { return _stereo ? _stereo->texture : nullptr; }
+
+ID3D11Texture2D* D3D11FrameSink::create_shared_texture(const D3D11_TEXTURE2D_DESC& desc,
+                                                       ComPtr<IDXGIKeyedMutex>* keyed_mutex,
+                                                       ComPtr<ID3D11Texture2D>* gst_texture)
+{
+    auto device = _s_UnityInterfaces->Get<IUnityGraphicsD3D11>()->GetDevice();
+    HRESULT hr = S_OK;
+
+    ComPtr<ID3D11Texture2D> texture;
+    hr = device->CreateTexture2D(&desc, nullptr, &texture);
+    g_assert(SUCCEEDED(hr));
+
+    hr = texture.As(keyed_mutex);
+    g_assert(SUCCEEDED(hr));
+
+    hr = (*keyed_mutex)->AcquireSync(0, INFINITE);
+    g_assert(SUCCEEDED(hr));
+
+    ComPtr<IDXGIResource1> dxgi_resource;
+    hr = texture.As(&dxgi_resource);
+    g_assert(SUCCEEDED(hr));
+
+    HANDLE shared_handle = nullptr;
+    hr = dxgi_resource->CreateSharedHandle(nullptr, DXGI_SHARED_RESOURCE_READ | DXGI_SHARED_RESOURCE_WRITE, nullptr,
+                                           &shared_handle);
+    g_assert(SUCCEEDED(hr));
+
+    auto gst_device = gst_d3d11_device_get_device_handle(_device);
+    ComPtr<ID3D11Device1> device1;
+    hr = gst_device->QueryInterface(IID_PPV_ARGS(&device1));
+    g_assert(SUCCEEDED(hr));
+
+    /* if (pDebug == nullptr)
+    {
+        hr = device1->QueryInterface(IID_PPV_ARGS(&pDebug));
+        g_assert(SUCCEEDED(hr));
+    }*/
+
+    /* Open shared texture at GStreamer device side */
+    hr = device1->OpenSharedResource1(shared_handle, IID_PPV_ARGS(gst_texture->ReleaseAndGetAddressOf()));
+    g_assert(SUCCEEDED(hr));
+    /* Can close NT handle now */
+    CloseHandle(shared_handle);
+
+    /* The keyed mutex holds the reference of the texture */
+    return texture.Get();
+}
+
+// Render thread. The current surface is retired, Unity keeps sampling it until it picks the new one from GetTexturePtr.
+void D3D11FrameSink::allocate_surface(Target* target, unsigned int width, unsigned int height)
+{
+    gst_video_info_set_format(&target->out_info, GST_VIDEO_FORMAT_RGBA, width, height);
+
+    release_surface(&target->retired);
+    target->retired = target->surface;
+    target->surface = Surface();
+    Surface* surface = &target->surface;
+
+    // Create a texture 2D that can be shared
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT::DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX | D3D11_RESOURCE_MISC_SHARED_NTHANDLE;
+    // desc.MiscFlags = D3D11_RESOURCE_MISC_SHARED;
+
+    ComPtr<ID3D11Texture2D> gst_texture;
+    surface->texture = create_shared_texture(desc, &surface->keyed_mutex, &gst_texture);
+
+    /* Wrap shared texture with GstD3D11Memory in order to convert texture
+     * using converter API */
+    GstMemory* mem = gst_d3d11_allocator_alloc_wrapped(nullptr, _device, gst_texture.Get(),
+                                                       /* CPU accessible (staging texture) memory size is unknown.
+                                                        * Pass zero here, then GStreamer will calculate it */
+                                                       0, nullptr, nullptr);
+    g_assert(mem);
+
+    surface->shared_buffer = gst_buffer_new();
+    gst_buffer_append_memory(surface->shared_buffer, mem);
+    target->texture.store(surface->texture, std::memory_order_release);
+}
+
+// Eye of the stereo target: plain texture of our device, without keyed mutex nor Unity side
+void D3D11FrameSink::allocate_eye_surface(Target* target, unsigned int width, unsigned int height)
+{
+    gst_video_info_set_format(&target->out_info, GST_VIDEO_FORMAT_RGBA, width, height);
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT::DXGI_FORMAT_R8G8B8A8_UNORM;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+
+    GstMemory* mem = gst_d3d11_allocator_alloc(nullptr, _device, &desc);
+    g_assert(mem);
+
+    target->surface.shared_buffer = gst_buffer_new();
+    gst_buffer_append_memory(target->surface.shared_buffer, mem);
+    target->surface.texture =
+        static_cast<ID3D11Texture2D*>(gst_d3d11_memory_get_resource_handle(GST_D3D11_MEMORY_CAST(mem)));
+}
+
+void D3D11FrameSink::release_surface(Surface* surface)
+{
+    gst_clear_buffer(&surface->shared_buffer);
+    /* Drops the last reference of the texture */
+    surface->keyed_mutex = nullptr;
+    surface->texture = nullptr;
+}
+
+// The texture of the surface stays referenced by Unity, which gives it back through ReleaseTexture
+void D3D11FrameSink::release_target(std::unique_ptr<Target>& target)
+{
+    if (target == nullptr)
+        return;
+
+    gst_clear_buffer(&target->surface.shared_buffer);
+    release_surface(&target->retired);
+    gst_clear_caps(&target->last_caps);
+    target = nullptr;
+}
+
+void* D3D11FrameSink::GetTexturePtr(int stream)
+{
+    Target* target = get_target(stream);
+    if (target == nullptr)
+        return nullptr;
+    return target->texture.load(std::memory_order_acquire);
+}
+
+void D3D11FrameSink::ReleaseTexture(void* texture)
+{
+    if (texture == nullptr)
+        return;
+
+    if (_stereo != nullptr && _stereo->texture == texture)
+    {
+        for (auto& target : _targets)
+        {
+            if (target != nullptr && target->eye >= 0)
+                release_target(target);
+        }
+        /* Drops the last reference of the texture */
+        _stereo = nullptr;
+        return;
+    }
+
+    for (auto& target : _targets)
+    {
+        if (target != nullptr && target->retired.texture == texture)
+        {
+            release_surface(&target->retired);
+            return;
+        }
+    }
+    static_cast<ID3D11Texture2D*>(texture)->Release();
+}
+
+D3D11FrameSink::Target* D3D11FrameSink::prepare(int stream, GstSample* sample)
+{
+    Target* target = get_target(stream);
+    if (target == nullptr)
+    {
+        Debug::Log("target is null", Level::Warning);
+        return nullptr;
+    }
+
+    GstCaps* caps = gst_sample_get_caps(sample);
+
+    OutputConfig config;
+    if (take_output_config(stream, &config))
+        apply_output_config(target, stream, config);
+
+    /* Caps updated, pick the matching converter */
+    if (!target->last_caps || !gst_caps_is_equal(target->last_caps, caps))
+        update_converter(target, caps);
+
+    return target->conv ? target : nullptr;
+}
+
+bool D3D11FrameSink::Draw(int stream, GstSample* sample) { return DrawBatch(&stream, &sample, 1) != 0; }
+
+unsigned int D3D11FrameSink::DrawBatch(const int* streams, GstSample* const* samples, int count)
+{
+    Target* eyes[2] = {nullptr, nullptr};
+    GstBuffer* eye_buffers[2] = {nullptr, nullptr};
+    unsigned int drawn = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        Target* target = prepare(streams[i], samples[i]);
+        if (target == nullptr)
+            continue;
+
+        GstBuffer* buf = gst_sample_get_buffer(samples[i]);
+        if (target->eye >= 0)
+        {
+            eyes[target->eye] = target;
+            eye_buffers[target->eye] = buf;
+            continue;
+        }
+
+        target->surface.keyed_mutex->ReleaseSync(0);
+        /* Converter will take gst_d3d11_device_lock() and acquire sync */
+        if (gst_d3d11_converter_convert_buffer(target->conv, buf, target->surface.shared_buffer))
+            drawn |= 1u << streams[i];
+        else
+            Debug::Log("Cannot convert frame of stream " + std::to_string(streams[i]), Level::Warning);
+        target->surface.keyed_mutex->AcquireSync(0, INFINITE);
+    }
+
+    /* Eyes are streams 0 and 1 */
+    if ((eyes[0] || eyes[1]) && _stereo != nullptr)
+        drawn |= draw_stereo(eyes, eye_buffers);
+    return drawn;
+}
+
+unsigned int D3D11FrameSink::draw_stereo(Target* const eyes[2], GstBuffer* const buffers[2])
+{
+    ID3D11DeviceContext* context = gst_d3d11_device_get_device_context_handle(_device);
+
+    _stereo->keyed_mutex->ReleaseSync(0);
+    gst_d3d11_device_lock(_device);
+
+    unsigned int drawn = 0;
+    for (int eye = 0; eye < 2; eye++)
+    {
+        if (eyes[eye] &&
+            gst_d3d11_converter_convert_buffer_unlocked(eyes[eye]->conv, buffers[eye], eyes[eye]->surface.shared_buffer))
+            drawn |= 1u << eye;
+    }
+
+    /* An eye not drawn keeps its previous frame in the shared texture */
+    _stereo->gst_keyed_mutex->AcquireSync(0, INFINITE);
+    for (int eye = 0; eye < 2; eye++)
+    {
+        if (!(drawn & (1u << eye)))
+            continue;
+        if (_stereo->layout == StereoLayout::SideBySide)
+        {
+            context->CopySubresourceRegion(_stereo->gst_texture.Get(), 0, eye * _stereo->eye_width, 0, 0,
+                                           eyes[eye]->surface.texture, 0, nullptr);
+        }
+        else
+        {
+            context->CopySubresourceRegion(_stereo->gst_texture.Get(), D3D11CalcSubresource(0, eye, 1), 0, 0, 0,
+                                           eyes[eye]->surface.texture, 0, nullptr);
+        }
+    }
+    _stereo->gst_keyed_mutex->ReleaseSync(0);
+
+    gst_d3d11_device_unlock(_device);
+    _stereo->keyed_mutex->AcquireSync(0, INFINITE);
+    return drawn;
+}
+
+void D3D11FrameSink::apply_output_config(Target* target, int stream, const OutputConfig& config)
+{
+    const unsigned int width = config.width ? config.width : GST_VIDEO_INFO_WIDTH(&target->out_info);
+    const unsigned int height = config.height ? config.height : GST_VIDEO_INFO_HEIGHT(&target->out_info);
+    const bool resize = width != (unsigned int)GST_VIDEO_INFO_WIDTH(&target->out_info) ||
+                        height != (unsigned int)GST_VIDEO_INFO_HEIGHT(&target->out_info);
+    if (resize && target->eye >= 0)
+    {
+        Debug::Log("Eyes of the stereo target keep their size", Level::Warning);
+    }
+    else if (resize)
+    {
+        Debug::Log("Resize target to " + std::to_string(width) + "x" + std::to_string(height));
+        allocate_surface(target, width, height);
+        publish_target_size(stream, width, height);
+    }
+    target->config = config;
+
+    /* Pick the converter matching the new output on this draw */
+    target->conv = nullptr;
+    gst_clear_caps(&target->last_caps);
+}
+
+GstD3D11Converter* D3D11FrameSink::create_converter(const GstVideoInfo* in_info, const GstVideoInfo* out_info)
+{
+    Debug::Log("Create new converter " + std::to_string(GST_VIDEO_INFO_WIDTH(in_info)) + "x" +
+               std::to_string(GST_VIDEO_INFO_HEIGHT(in_info)));
+
+    /* In case of shared texture, video processor might not behave as expected.
+     * Use only pixel shader */
+    auto config = gst_structure_new("converter-config", GST_D3D11_CONVERTER_OPT_BACKEND, GST_TYPE_D3D11_CONVERTER_BACKEND,
+                                    GST_D3D11_CONVERTER_BACKEND_SHADER, nullptr);
+
+    return gst_d3d11_converter_new(_device, in_info, out_info, config);
+}
+
+void D3D11FrameSink::update_converter(Target* target, GstCaps* caps)
+{
+    target->conv = nullptr;
+    gst_clear_caps(&target->last_caps);
+
+    if (!gst_video_info_from_caps(&target->in_info, caps))
+    {
+        Debug::Log("Cannot parse sample caps", Level::Error);
+        return;
+    }
+
+    /* Build the converters of the other known resolutions now, so that switching to them costs nothing */
+    const std::vector<GstVideoInfo> prewarm = get_prewarm_infos(&target->in_info);
+    target->converters.SetCapacity(std::max<size_t>(target->converters.GetCapacity(), prewarm.size() + 1));
+    for (const auto& info : prewarm)
+    {
+        target->converters.Acquire(&info, &target->out_info, GST_D3D11_CONVERTER_BACKEND_SHADER, nullptr,
+                                   [&]() { return create_converter(&info, &target->out_info); });
+    }
+
+    target->conv = target->converters.Acquire(&target->in_info, &target->out_info, GST_D3D11_CONVERTER_BACKEND_SHADER,
+                                              nullptr, [&]() { return create_converter(&target->in_info, &target->out_info); });
+    if (!target->conv)
+    {
+        Debug::Log("Cannot create video converter", Level::Error);
+        return;
+    }
+
+    /* Crop and letterbox are converter properties, updated in place */
+    GstVideoRectangle src, dst;
+    compute_rectangles(target->config, &target->in_info, &target->out_info, &src, &dst);
+    g_object_set(target->conv, "src-x", src.x, "src-y", src.y, "src-width", src.w, "src-height", src.h, "dest-x", dst.x,
+                 "dest-y", dst.y, "dest-width", dst.w, "dest-height", dst.h, "fill-border", TRUE, nullptr);
+
+    gst_caps_replace(&target->last_caps, caps);
+}
+
+void D3D11FrameSink::Flush()
+{
+    /* Converters stay cached for the next connection */
+    for (auto& target : _targets)
+    {
+        if (target == nullptr)
+            continue;
+        gst_clear_caps(&target->last_caps);
+        target->conv = nullptr;
+    }
+
+    // pDebug->ReportLiveDeviceObjects(D3D11_RLDO_DETAIL | D3D11_RLDO_IGNORE_INTERNAL);
+    // pDebug = nullptr;
+}
+
+GstElement* D3D11FrameSink::add_video_convert(GstElement* pipeline)
+{
+    GstElement* d3d11convert = gst_element_factory_make("d3d11convert", nullptr);
+    if (!d3d11convert)
+    {
+        Debug::Log("Failed to create d3d11convert", Level::Error);
+        return nullptr;
+    }
+    gst_bin_add(GST_BIN(pipeline), d3d11convert);
+    return d3d11convert;
+}
+
+GstCaps* D3D11FrameSink::get_appsink_caps() { return gst_caps_from_string("video/x-raw(memory:D3D11Memory),format=RGBA"); }
+
+bool D3D11FrameSink::OnNeedContext(GstMessage* msg)
+{
+    const gchar* ctx_type;
+    if (!gst_message_parse_context_type(msg, &ctx_type))
+        return false;
+
+    /* non-d3d11 context message is not interested */
+    if (g_strcmp0(ctx_type, GST_D3D11_DEVICE_HANDLE_CONTEXT_TYPE) != 0)
+        return false;
+
+    /* Pass our device to the message source element.
+     * Otherwise pipeline will create another device */
+    SetContext(GST_ELEMENT(msg->src));
+    return true;
+}
+
+void D3D11FrameSink::SetContext(GstElement* element)
+{
+    auto context = gst_d3d11_context_new(_device);
+    gst_element_set_context(element, context);
+    gst_context_unref(context);
+}
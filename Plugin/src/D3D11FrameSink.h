@@ -0,0 +1,103 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include "ConverterCache.h"
+#include "FrameSink.h"
+#include "Unity/IUnityInterface.h"
+#include <atomic>
+#include <d3d11.h>
+#include <gst/d3d11/gstd3d11.h>
+#include <memory>
+#include <wrl.h>
+
+/* Hardware decode into D3D11 memory, converted into textures shared with the Unity device.
+ * With a stereo target, both eyes are converted into textures of our device then copied into the shared
+ * texture under a single device lock and keyed mutex sync. */
+class D3D11FrameSink : public FrameSink
+{
+private:
+    GstD3D11Device* _device = nullptr;
+    IUnityInterfaces* _s_UnityInterfaces = nullptr;
+
+    struct Surface
+    {
+        Microsoft::WRL::ComPtr<IDXGIKeyedMutex> keyed_mutex = nullptr;
+        GstBuffer* shared_buffer = nullptr;
+        ID3D11Texture2D* texture = nullptr;
+    };
+
+    struct Target
+    {
+        Surface surface;
+        /* Surface replaced by a resize, kept until Unity releases it or the next resize */
+        Surface retired;
+        std::atomic<ID3D11Texture2D*> texture{nullptr};
+        /* Everything below is only touched by the render thread */
+        int eye = -1; // surface is a texture of our device, copied into the stereo target
+        GstVideoInfo out_info;
+        OutputConfig config;
+        GstCaps* last_caps = nullptr;
+        GstVideoInfo in_info;
+        GstD3D11Converter* conv = nullptr; // owned by converters
+        ConverterCache<GstD3D11Converter> converters{[](GstD3D11Converter* conv) { gst_object_unref(conv); }};
+    };
+
+    std::unique_ptr<Target> _targets[MAX_STREAMS];
+
+    struct Stereo
+    {
+        StereoLayout layout;
+        unsigned int eye_width;
+        unsigned int eye_height;
+        Microsoft::WRL::ComPtr<IDXGIKeyedMutex> keyed_mutex = nullptr;     // Unity device side
+        Microsoft::WRL::ComPtr<ID3D11Texture2D> gst_texture = nullptr;     // opened on our device
+        Microsoft::WRL::ComPtr<IDXGIKeyedMutex> gst_keyed_mutex = nullptr; // of gst_texture
+        ID3D11Texture2D* texture = nullptr;
+    };
+    std::unique_ptr<Stereo> _stereo;
+
+public:
+    D3D11FrameSink(IUnityInterfaces* s_UnityInterfaces);
+    ~D3D11FrameSink() override;
+
+    const char* GetName() const override { return "d3d11"; }
+
+    void CreateDevice() override;
+    void* CreateTexture(unsigned int width, unsigned int height, int stream) override;
+    void* GetTexturePtr(int stream) override;
+    void ReleaseTexture(void* texture) override;
+    void* CreateStereoTexture(unsigned int eye_width, unsigned int eye_height, StereoLayout layout) override;
+    void* GetStereoTexturePtr() override;
+
+    bool Draw(int stream, GstSample* sample) override;
+    unsigned int DrawBatch(const int* streams, GstSample* const* samples, int count) override;
+    void Flush() override;
+
+    // Software decoders are uploaded by d3d11convert
+    bool AcceptsDecoder(DecoderKind kind) const override { return kind != DecoderKind::Hardware; }
+    GstElement* add_video_convert(GstElement* pipeline) override;
+    GstCaps* get_appsink_caps() override;
+
+    bool OnNeedContext(GstMessage* msg) override;
+    void SetContext(GstElement* element) override;
+
+private:
+    Target* get_target(int stream) { return IsValidStream(stream) ? _targets[stream].get() : nullptr; }
+    // Texture of the Unity device opened on ours, keyed mutex acquired by Unity (key 0)
+    ID3D11Texture2D* create_shared_texture(const D3D11_TEXTURE2D_DESC& desc,
+                                           Microsoft::WRL::ComPtr<IDXGIKeyedMutex>* keyed_mutex,
+                                           Microsoft::WRL::ComPtr<ID3D11Texture2D>* gst_texture);
+    void allocate_surface(Target* target, unsigned int width, unsigned int height);
+    void allocate_eye_surface(Target* target, unsigned int width, unsigned int height);
+    // Applies the pending output config and caps, returns the target if the sample can be converted
+    Target* prepare(int stream, GstSample* sample);
+    // Returns the eyes written, bit 1 << eye set for each
+    unsigned int draw_stereo(Target* const eyes[2], GstBuffer* const buffers[2]);
+    static void release_surface(Surface* surface);
+    static void release_target(std::unique_ptr<Target>& target);
+    void apply_output_config(Target* target, int stream, const OutputConfig& config);
+    GstD3D11Converter* create_converter(const GstVideoInfo* in_info, const GstVideoInfo* out_info);
+    void update_converter(Target* target, GstCaps* caps);
+};
@@ -4,6 +4,7 @@
 
 #include "DebugLog.h"
 
+#include <cstring>
 #include <sstream>
 #include <stdio.h>
 #include <string>
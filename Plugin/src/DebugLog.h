@@ -8,7 +8,11 @@
 #include <stdio.h>
 #include <string>
 
+#if defined(_WIN32)
 #define DLLExport __declspec(dllexport)
+#else
+#define DLLExport __attribute__((visibility("default")))
+#endif
 
 extern "C"
 {
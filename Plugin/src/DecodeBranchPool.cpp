@@ -0,0 +1,66 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "DecodeBranchPool.h"
+#include "DebugLog.h"
+
+DecodeBranchPool::~DecodeBranchPool() { Clear(); }
+
+bool DecodeBranchPool::Acquire(const std::string& key, DecodeBranch* branch)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    for (auto it = idle_.begin(); it != idle_.end(); ++it)
+    {
+        if (it->key == key)
+        {
+            *branch = std::move(*it);
+            idle_.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+void DecodeBranchPool::Release(DecodeBranch branch)
+{
+    if (gst_element_set_state(branch.bin, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE)
+    {
+        Debug::Log("Cannot bring " + branch.key + " branch back to READY, dropping it", Level::Warning);
+        destroy(branch);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lk(lock_);
+    idle_.push_back(std::move(branch));
+}
+
+size_t DecodeBranchPool::Count(const std::string& key)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    size_t count = 0;
+    for (const auto& branch : idle_)
+    {
+        if (branch.key == key)
+            count++;
+    }
+    return count;
+}
+
+void DecodeBranchPool::Clear()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    for (auto& branch : idle_)
+        destroy(branch);
+    idle_.clear();
+}
+
+void DecodeBranchPool::destroy(DecodeBranch& branch)
+{
+    if (branch.bin == nullptr)
+        return;
+    gst_element_set_state(branch.bin, GST_STATE_NULL);
+    gst_clear_object(&branch.bin);
+    branch.entry = nullptr;
+    branch.sink = nullptr;
+}
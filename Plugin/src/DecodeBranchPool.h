@@ -0,0 +1,41 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <gst/gst.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Decode branch built as a bin with a ghost "sink" pad, linked to a webrtcsrc pad */
+struct DecodeBranch
+{
+    std::string key;               // "video/<encoding>" or "audio/<encoding>"
+    GstElement* bin = nullptr;     // owned reference
+    GstElement* entry = nullptr;   // depayloader
+    GstElement* decoder = nullptr;
+    GstElement* sink = nullptr;    // appsink for video, audio sink for audio
+};
+
+/* Idle decode branches kept in READY so that a reconnection only has to relink them.
+ * Thread safe, branches are taken from pad-added and given back when the pipeline stops. */
+class DecodeBranchPool
+{
+private:
+    std::mutex lock_;
+    std::vector<DecodeBranch> idle_;
+
+public:
+    DecodeBranchPool() = default;
+    ~DecodeBranchPool();
+
+    // Returns false if no idle branch matches the key
+    bool Acquire(const std::string& key, DecodeBranch* branch);
+    // Brings the branch back to READY and keeps it for later. The branch must not have a parent anymore.
+    void Release(DecodeBranch branch);
+    size_t Count(const std::string& key);
+    void Clear();
+
+    static void destroy(DecodeBranch& branch);
+};
@@ -0,0 +1,92 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "FrameLeases.h"
+#include "DebugLog.h"
+
+FrameLeases::~FrameLeases()
+{
+    Clear();
+    if (outstanding_ > 0)
+        Debug::Log(std::to_string(outstanding_) + " frame leases not released", Level::Warning);
+}
+
+void FrameLeases::SetEnabled(bool enabled)
+{
+    enabled_ = enabled;
+    if (!enabled)
+        Clear();
+}
+
+void FrameLeases::Publish(GstSample* sample)
+{
+    if (!enabled_.load(std::memory_order_relaxed))
+        return;
+
+    std::lock_guard<std::mutex> lk(lock_);
+    gst_sample_replace(&latest_, sample);
+    sequence_++;
+}
+
+void FrameLeases::Clear()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    gst_clear_sample(&latest_);
+}
+
+bool FrameLeases::Acquire(FrameLeaseInfo* info)
+{
+    GstSample* sample = nullptr;
+    {
+        std::lock_guard<std::mutex> lk(lock_);
+        if (latest_ == nullptr)
+            return false;
+        sample = gst_sample_ref(latest_);
+        info->sequence = sequence_;
+    }
+
+    /* Mapped outside of the lock, the streaming thread must not wait on it */
+    Lease* lease = new Lease();
+    lease->owner = this;
+    lease->sample = sample;
+
+    GstVideoInfo video_info;
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    if (buffer == nullptr || !gst_video_info_from_caps(&video_info, gst_sample_get_caps(sample)) ||
+        !gst_video_frame_map(&lease->frame, &video_info, buffer, GST_MAP_READ))
+    {
+        Debug::Log("Cannot map leased frame", Level::Error);
+        gst_sample_unref(sample);
+        delete lease;
+        return false;
+    }
+
+    info->handle = lease;
+    info->pts = GST_BUFFER_PTS_IS_VALID(buffer) ? (gint64)GST_BUFFER_PTS(buffer) : -1;
+    info->width = GST_VIDEO_FRAME_WIDTH(&lease->frame);
+    info->height = GST_VIDEO_FRAME_HEIGHT(&lease->frame);
+    info->format = GST_VIDEO_FRAME_FORMAT(&lease->frame);
+    info->n_planes = GST_VIDEO_FRAME_N_PLANES(&lease->frame);
+    for (int i = 0; i < GST_VIDEO_MAX_PLANES; i++)
+    {
+        const bool used = i < info->n_planes;
+        info->data[i] = used ? GST_VIDEO_FRAME_PLANE_DATA(&lease->frame, i) : nullptr;
+        info->stride[i] = used ? GST_VIDEO_FRAME_PLANE_STRIDE(&lease->frame, i) : 0;
+    }
+
+    outstanding_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void FrameLeases::Release(void* handle)
+{
+    if (handle == nullptr)
+        return;
+
+    Lease* lease = static_cast<Lease*>(handle);
+    gst_video_frame_unmap(&lease->frame);
+    gst_sample_unref(lease->sample);
+    lease->owner->outstanding_.fetch_sub(1, std::memory_order_relaxed);
+    delete lease;
+}
@@ -0,0 +1,63 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <atomic>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <mutex>
+
+/* Filled by AcquireFrameLease. Layout shared with the managed side. */
+struct FrameLeaseInfo
+{
+    void* handle;      // to give back to ReleaseFrameLease
+    guint64 sequence;  // increases with every decoded frame, equal values mean the same frame
+    gint64 pts;        // nanoseconds, -1 if unknown
+    gint32 width;
+    gint32 height;
+    gint32 format;     // GstVideoFormat
+    gint32 n_planes;
+    void* data[GST_VIDEO_MAX_PLANES];
+    gint32 stride[GST_VIDEO_MAX_PLANES];
+};
+
+/* Read access to the latest decoded sample of a stream, in place.
+ * A lease keeps the sample referenced and its video frame mapped until released, so the pixels stay valid
+ * however many frames are decoded meanwhile. Only samples in system memory are read without copy,
+ * mapping D3D11 memory goes through a staging texture.
+ * Publish is called from the appsink streaming thread, the rest from any thread. */
+class FrameLeases
+{
+private:
+    struct Lease
+    {
+        FrameLeases* owner;
+        GstSample* sample;
+        GstVideoFrame frame;
+    };
+
+    std::mutex lock_;
+    GstSample* latest_ = nullptr;
+    guint64 sequence_ = 0;
+    std::atomic<bool> enabled_{false};
+    std::atomic<int> outstanding_{0};
+
+public:
+    FrameLeases() = default;
+    ~FrameLeases();
+    FrameLeases(const FrameLeases&) = delete;
+    FrameLeases& operator=(const FrameLeases&) = delete;
+
+    // Disabled by default: keeping the latest sample holds one more buffer from the decoder pool
+    void SetEnabled(bool enabled);
+    // Does not take ownership of the sample
+    void Publish(GstSample* sample);
+    // Drops the latest sample, leases in use stay valid
+    void Clear();
+
+    // Returns false if there is no sample yet or it cannot be mapped
+    bool Acquire(FrameLeaseInfo* info);
+    static void Release(void* handle);
+    int GetOutstanding() const { return outstanding_.load(std::memory_order_relaxed); }
+};
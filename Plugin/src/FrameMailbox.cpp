@@ -0,0 +1,50 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "FrameMailbox.h"
+
+FrameMailbox::~FrameMailbox()
+{
+    for (auto& slot : slots_)
+        gst_clear_sample(&slot);
+}
+
+void FrameMailbox::Push(GstSample* sample)
+{
+    slots_[back_] = sample;
+    received_.fetch_add(1, std::memory_order_relaxed);
+
+    const uint8_t prev = middle_.exchange(back_ | DIRTY, std::memory_order_acq_rel);
+    back_ = prev & INDEX_MASK;
+
+    /* The consumer never saw the previous sample, release it now so that
+     * the back slot is always empty for the next push */
+    if (prev & DIRTY)
+    {
+        gst_clear_sample(&slots_[back_]);
+        overwritten_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+GstSample* FrameMailbox::Take()
+{
+    /* Only the consumer clears the flag, so it cannot vanish before the exchange */
+    if (!(middle_.load(std::memory_order_acquire) & DIRTY))
+        return nullptr;
+
+    const uint8_t prev = middle_.exchange(front_, std::memory_order_acq_rel);
+    front_ = prev & INDEX_MASK;
+
+    GstSample* sample = slots_[front_];
+    slots_[front_] = nullptr;
+    taken_.fetch_add(1, std::memory_order_relaxed);
+    return sample;
+}
+
+void FrameMailbox::Clear()
+{
+    const uint8_t prev = middle_.fetch_and(INDEX_MASK, std::memory_order_acq_rel);
+    if (prev & DIRTY)
+        gst_clear_sample(&slots_[prev & INDEX_MASK]);
+}
@@ -0,0 +1,46 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <gst/gst.h>
+
+/* Wait-free triple buffer handing decoded samples from the appsink streaming
+ * thread (producer) to the render thread (consumer).
+ * The producer never blocks and the consumer always gets the newest sample.
+ * Samples replaced before the consumer took them are counted as overwritten. */
+class FrameMailbox
+{
+public:
+    FrameMailbox() = default;
+    ~FrameMailbox();
+    FrameMailbox(const FrameMailbox&) = delete;
+    FrameMailbox& operator=(const FrameMailbox&) = delete;
+
+    // Producer side. Takes ownership of the sample.
+    void Push(GstSample* sample);
+    // Consumer side. Returns the newest sample not taken yet (caller owns it), or nullptr.
+    GstSample* Take();
+    // Drops the pending sample, if any. Only call once the producer is stopped and no Take() is running.
+    void Clear();
+
+    guint64 GetReceived() const { return received_.load(std::memory_order_relaxed); }
+    guint64 GetTaken() const { return taken_.load(std::memory_order_relaxed); }
+    guint64 GetOverwritten() const { return overwritten_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t DIRTY = 0x4;
+
+    GstSample* slots_[3] = {nullptr, nullptr, nullptr};
+    // Index of the shared slot, flagged DIRTY when it holds a sample not taken yet
+    std::atomic<uint8_t> middle_{1};
+    uint8_t back_ = 0;  // owned by the producer
+    uint8_t front_ = 2; // owned by the consumer
+
+    std::atomic<guint64> received_{0};
+    std::atomic<guint64> taken_{0};
+    std::atomic<guint64> overwritten_{0};
+};
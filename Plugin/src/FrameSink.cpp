@@ -0,0 +1,105 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "FrameSink.h"
+
+void FrameSink::AddPrewarmResolution(unsigned int width, unsigned int height)
+{
+    std::lock_guard<std::mutex> lk(_prewarm_lock);
+    _prewarm_sizes.emplace_back(width, height);
+}
+
+std::vector<GstVideoInfo> FrameSink::get_prewarm_infos(const GstVideoInfo* in_info)
+{
+    std::vector<GstVideoInfo> infos;
+
+    std::lock_guard<std::mutex> lk(_prewarm_lock);
+    for (const auto& size : _prewarm_sizes)
+    {
+        if (size.first == (unsigned int)GST_VIDEO_INFO_WIDTH(in_info) &&
+            size.second == (unsigned int)GST_VIDEO_INFO_HEIGHT(in_info))
+            continue;
+
+        GstVideoInfo info;
+        gst_video_info_set_format(&info, GST_VIDEO_INFO_FORMAT(in_info), size.first, size.second);
+        info.colorimetry = in_info->colorimetry;
+        info.chroma_site = in_info->chroma_site;
+        info.par_n = in_info->par_n;
+        info.par_d = in_info->par_d;
+        info.fps_n = in_info->fps_n;
+        info.fps_d = in_info->fps_d;
+        infos.push_back(info);
+    }
+    return infos;
+}
+
+void FrameSink::SetOutputConfig(int stream, const OutputConfig& config)
+{
+    if (!IsValidStream(stream))
+        return;
+    std::lock_guard<std::mutex> lk(_output_lock);
+    _pending_output[stream] = config;
+    _output_dirty[stream].store(true, std::memory_order_release);
+}
+
+bool FrameSink::take_output_config(int stream, OutputConfig* config)
+{
+    /* Checked on every draw, only lock when there is something to take */
+    if (!_output_dirty[stream].exchange(false, std::memory_order_acquire))
+        return false;
+
+    std::lock_guard<std::mutex> lk(_output_lock);
+    *config = _pending_output[stream];
+    return true;
+}
+
+void FrameSink::publish_target_size(int stream, unsigned int width, unsigned int height)
+{
+    _target_size[stream].store((static_cast<guint64>(width) << 32) | height, std::memory_order_release);
+}
+
+void FrameSink::GetTargetSize(int stream, unsigned int* width, unsigned int* height) const
+{
+    const guint64 size = IsValidStream(stream) ? _target_size[stream].load(std::memory_order_acquire) : 0;
+    *width = static_cast<unsigned int>(size >> 32);
+    *height = static_cast<unsigned int>(size & 0xffffffff);
+}
+
+void FrameSink::compute_rectangles(const OutputConfig& config, const GstVideoInfo* in_info, const GstVideoInfo* out_info,
+                                   GstVideoRectangle* src, GstVideoRectangle* dst)
+{
+    const int in_width = GST_VIDEO_INFO_WIDTH(in_info);
+    const int in_height = GST_VIDEO_INFO_HEIGHT(in_info);
+
+    /* Region of interest, clamped to the frame */
+    src->x = CLAMP(config.crop_x, 0, in_width - 1);
+    src->y = CLAMP(config.crop_y, 0, in_height - 1);
+    src->w = config.crop_width > 0 ? MIN(config.crop_width, in_width - src->x) : in_width - src->x;
+    src->h = config.crop_height > 0 ? MIN(config.crop_height, in_height - src->y) : in_height - src->y;
+
+    GstVideoRectangle target = {0, 0, GST_VIDEO_INFO_WIDTH(out_info), GST_VIDEO_INFO_HEIGHT(out_info)};
+    *dst = target;
+
+    switch (config.letterbox)
+    {
+        case Letterbox::Stretch:
+            break;
+        case Letterbox::Fit:
+            gst_video_center_rect(src, &target, dst, TRUE);
+            break;
+        case Letterbox::Fill:
+        {
+            /* Shrink the source to the target aspect ratio, keeping it centered */
+            GstVideoRectangle cropped = {0, 0, src->w, src->h};
+            if ((gint64)src->w * target.h > (gint64)src->h * target.w)
+                cropped.w = (int)gst_util_uint64_scale_int(src->h, target.w, target.h);
+            else
+                cropped.h = (int)gst_util_uint64_scale_int(src->w, target.h, target.w);
+            cropped.x = src->x + (src->w - cropped.w) / 2;
+            cropped.y = src->y + (src->h - cropped.h) / 2;
+            *src = cropped;
+            break;
+        }
+    }
+}
@@ -0,0 +1,129 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <atomic>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+enum class DecoderKind
+{
+    D3D11,    // hardware decoder producing D3D11 memory
+    Hardware, // other hardware decoders (VA-API, ...) able to output system memory
+    Software
+};
+
+enum class Letterbox
+{
+    Stretch, // source rectangle scaled to the whole target
+    Fit,     // aspect ratio kept, black borders
+    Fill     // aspect ratio kept, source rectangle cropped to the target aspect ratio
+};
+
+enum class StereoLayout
+{
+    SideBySide, // one 2 * width x height target, left eye on the left
+    Array       // two slices, left eye first. The CPU backend packs them as a width x 2 * height buffer.
+};
+
+struct OutputConfig
+{
+    unsigned int width = 0; // 0 keeps the current target size
+    unsigned int height = 0;
+    /* Source region of interest, a zero width or height selects the whole frame */
+    int crop_x = 0;
+    int crop_y = 0;
+    int crop_width = 0;
+    int crop_height = 0;
+    Letterbox letterbox = Letterbox::Stretch;
+};
+
+/* Output surface of the video receive path.
+ * A backend tells which decoders it can take, provides the tail of the decode branch
+ * (optional converter and appsink caps) and presents the decoded samples into the targets handed to Unity.
+ * CreateTexture, GetTexturePtr, Draw and Flush are called on the render thread. */
+class FrameSink
+{
+public:
+    // Streams are numbered after the webrtcsrc video pads (video_N), 0 and 1 being the left and right eyes
+    static constexpr int MAX_STREAMS = 8;
+
+private:
+    std::mutex _prewarm_lock;
+    std::vector<std::pair<unsigned int, unsigned int>> _prewarm_sizes;
+
+    std::mutex _output_lock;
+    OutputConfig _pending_output[MAX_STREAMS];
+    std::atomic<bool> _output_dirty[MAX_STREAMS] = {};
+    std::atomic<guint64> _target_size[MAX_STREAMS] = {};
+
+public:
+    FrameSink() = default;
+    virtual ~FrameSink() = default;
+
+    virtual const char* GetName() const = 0;
+
+    virtual void CreateDevice() = 0;
+    virtual void* CreateTexture(unsigned int width, unsigned int height, int stream) = 0;
+    virtual void* GetTexturePtr(int stream) = 0;
+    virtual void ReleaseTexture(void* texture) = 0;
+    // Single target receiving both eyes (streams 0 and 1), written in one go by DrawBatch.
+    // It replaces their own targets, a later CreateTexture of an eye takes it out of the stereo target.
+    virtual void* CreateStereoTexture(unsigned int eye_width, unsigned int eye_height, StereoLayout layout) = 0;
+    virtual void* GetStereoTexturePtr() = 0;
+
+    // Converts the sample into the target of the given stream. The sample stays owned by the caller.
+    // Returns false when nothing was written: no target, no converter or a failed conversion.
+    virtual bool Draw(int stream, GstSample* sample) = 0;
+    // Draws several streams, returns once every target is complete. Backends may convert them concurrently.
+    // Returns the streams actually written, bit 1 << stream set for each.
+    virtual unsigned int DrawBatch(const int* streams, GstSample* const* samples, int count)
+    {
+        unsigned int drawn = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (Draw(streams[i], samples[i]))
+                drawn |= 1u << streams[i];
+        }
+        return drawn;
+    }
+    // Threads used by Draw for the conversion, 0 for one per core. Ignored by GPU backends.
+    virtual void SetThreadCount(unsigned int count) {}
+    // Drops converters and caps once the pipeline is stopped
+    virtual void Flush() = 0;
+
+    virtual bool AcceptsDecoder(DecoderKind kind) const = 0;
+    // May return nullptr when no conversion is done inside the pipeline
+    virtual GstElement* add_video_convert(GstElement* pipeline) = 0;
+    virtual GstCaps* get_appsink_caps() = 0;
+
+    // Called from the bus sync handler. Returns true if a context has been set on the source element.
+    virtual bool OnNeedContext(GstMessage* msg) { return false; }
+    // Gives the backend context to elements prepared outside of the pipeline (no bus to ask for it)
+    virtual void SetContext(GstElement* element) {}
+
+    // Input resolution the sender is known to use: its converter is built along with the first one
+    void AddPrewarmResolution(unsigned int width, unsigned int height);
+
+    // Any thread. Applied by the next Draw of that stream, a new size reallocates the target (see GetTexturePtr).
+    void SetOutputConfig(int stream, const OutputConfig& config);
+    // Current size of the target, 0 when there is none
+    void GetTargetSize(int stream, unsigned int* width, unsigned int* height) const;
+
+    static bool IsValidStream(int stream) { return stream >= 0 && stream < MAX_STREAMS; }
+
+protected:
+    // Infos of the pre-warm resolutions, with the format and colorimetry of in_info
+    std::vector<GstVideoInfo> get_prewarm_infos(const GstVideoInfo* in_info);
+
+    // Returns true and fills config if SetOutputConfig has been called since the last call
+    bool take_output_config(int stream, OutputConfig* config);
+    void publish_target_size(int stream, unsigned int width, unsigned int height);
+    // Source and destination rectangles of the conversion of in_info into out_info
+    static void compute_rectangles(const OutputConfig& config, const GstVideoInfo* in_info, const GstVideoInfo* out_info,
+                                   GstVideoRectangle* src, GstVideoRectangle* dst);
+};
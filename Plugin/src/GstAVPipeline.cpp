@@ -3,97 +3,86 @@
  LICENSE file in the root directory of this source tree. */
 
 #include "GstAVPipeline.h"
+#include "CpuFrameSink.h"
 #include "DebugLog.h"
+#include <cstring>
 
-#include <d3d11_1.h>
-#include <d3d11sdklayers.h>
-#include <dxgi1_2.h>
-#include <dxgiformat.h>
+#ifdef _WIN32
+#include "D3D11FrameSink.h"
+#include "Unity/IUnityGraphics.h"
+#endif
 
-#include "Unity/IUnityGraphicsD3D11.h"
-using namespace Microsoft::WRL;
+void* GstAVPipeline::CreateTexture(unsigned int width, unsigned int height, int stream)
+{
+    AppData* data = register_stream(stream);
+    if (data == nullptr)
+        return nullptr;
+
+    void* texture = _sink->CreateTexture(width, height, stream);
+    data->displayed = texture != nullptr;
+    return texture;
+}
 
-// Call only on plugin thread
-// Creates the underlying D3D11 texture using the provided unity device.
-// This texture can then be turned into a proper Unity texture on the
-// managed side using Texture2D.CreateExternalTexture()
-ID3D11Texture2D* GstAVPipeline::CreateTexture(unsigned int width, unsigned int height, bool left)
+void* GstAVPipeline::GetTexturePtr(int stream) { return _sink->GetTexturePtr(stream); }
+
+void* GstAVPipeline::CreateStereoTexture(unsigned int eye_width, unsigned int eye_height, StereoLayout layout)
 {
-    auto device = _s_UnityInterfaces->Get<IUnityGraphicsD3D11>()->GetDevice();
-    HRESULT hr = S_OK;
+    AppData* left = register_stream(0);
+    AppData* right = register_stream(1);
+    if (left == nullptr || right == nullptr)
+        return nullptr;
 
-    if (_render_info.width != width)
-        gst_video_info_set_format(&_render_info, GST_VIDEO_FORMAT_RGBA, width, height);
+    void* texture = _sink->CreateStereoTexture(eye_width, eye_height, layout);
+    left->displayed = texture != nullptr;
+    right->displayed = texture != nullptr;
+    return texture;
+}
 
-    std::unique_ptr<AppData> data = std::make_unique<AppData>();
-    data->avpipeline = this;
-    
-    // Create a texture 2D that can be shared
-    D3D11_TEXTURE2D_DESC desc = {};
-    desc.Width = width;
-    desc.Height = height;
-    desc.MipLevels = 1;
-    desc.ArraySize = 1;
-    desc.Format = DXGI_FORMAT::DXGI_FORMAT_R8G8B8A8_UNORM;
-    desc.SampleDesc.Count = 1;
-    desc.Usage = D3D11_USAGE_DEFAULT;
-    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
-    desc.MiscFlags = D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX | D3D11_RESOURCE_MISC_SHARED_NTHANDLE;
-    // desc.MiscFlags = D3D11_RESOURCE_MISC_SHARED;
-
-    ComPtr<ID3D11Texture2D> texture;
-    hr = device->CreateTexture2D(&desc, nullptr, &texture);
-    g_assert(SUCCEEDED(hr));
-
-    hr = texture.As(&data->keyed_mutex);
-    g_assert(SUCCEEDED(hr));
-
-    hr = data->keyed_mutex->AcquireSync(0, INFINITE);
-    g_assert(SUCCEEDED(hr));
-
-    ComPtr<IDXGIResource1> dxgi_resource;
-    hr = texture.As(&dxgi_resource);
-    g_assert(SUCCEEDED(hr));
-
-    HANDLE shared_handle = nullptr;
-    hr = dxgi_resource->CreateSharedHandle(nullptr, DXGI_SHARED_RESOURCE_READ | DXGI_SHARED_RESOURCE_WRITE, nullptr,
-                                           &shared_handle);
-    g_assert(SUCCEEDED(hr));
-
-    auto gst_device = gst_d3d11_device_get_device_handle(_device);
-    ComPtr<ID3D11Device1> device1;
-    hr = gst_device->QueryInterface(IID_PPV_ARGS(&device1));
-    g_assert(SUCCEEDED(hr));
-
-    /* if (pDebug == nullptr)
-    {
-        hr = device1->QueryInterface(IID_PPV_ARGS(&pDebug));
-        g_assert(SUCCEEDED(hr));
-    }*/
-    
-    /* Open shared texture at GStreamer device side */
-    ComPtr<ID3D11Texture2D> gst_texture;
-    hr = device1->OpenSharedResource1(shared_handle, IID_PPV_ARGS(&gst_texture));
-    g_assert(SUCCEEDED(hr));
-    /* Can close NT handle now */
-    CloseHandle(shared_handle);
-
-    /* Wrap shared texture with GstD3D11Memory in order to convert texture
-     * using converter API */
-    GstMemory* mem = gst_d3d11_allocator_alloc_wrapped(nullptr, _device, gst_texture.Get(),
-                                                       /* CPU accessible (staging texture) memory size is unknown.
-                                                        * Pass zero here, then GStreamer will calculate it */
-                                                  0, nullptr, nullptr);
-    g_assert(mem);
-
-    data->shared_buffer = gst_buffer_new();
-    gst_buffer_append_memory(data->shared_buffer, mem);
+void* GstAVPipeline::GetStereoTexturePtr() { return _sink->GetStereoTexturePtr(); }
 
-    if (left)
-        _leftData = std::move(data);
-    else
-        _rightData = std::move(data);    
-    return texture.Get();
+GstAVPipeline::AppData* GstAVPipeline::get_stream(int stream)
+{
+    if (!FrameSink::IsValidStream(stream))
+        return nullptr;
+    return _streams[stream].load(std::memory_order_acquire);
+}
+
+GstAVPipeline::AppData* GstAVPipeline::register_stream(int stream)
+{
+    if (!FrameSink::IsValidStream(stream))
+    {
+        Debug::Log("Stream " + std::to_string(stream) + " out of range, at most " +
+                       std::to_string(FrameSink::MAX_STREAMS) + " streams",
+                   Level::Error);
+        return nullptr;
+    }
+
+    AppData* data = _streams[stream].load(std::memory_order_acquire);
+    if (data != nullptr)
+        return data;
+
+    /* Render thread and pad-added may race to create it */
+    AppData* created = new AppData();
+    created->avpipeline = this;
+    created->stream = stream;
+    created->keyframes.Configure(_keyframe_min_interval_us, _keyframe_max_interval_us);
+    if (_streams[stream].compare_exchange_strong(data, created, std::memory_order_acq_rel))
+        return created;
+
+    delete created;
+    return data;
+}
+
+int GstAVPipeline::get_stream_handle(const gchar* pad_name)
+{
+    if (!g_str_has_prefix(pad_name, "video_"))
+        return -1;
+
+    gchar* end = nullptr;
+    const guint64 handle = g_ascii_strtoull(pad_name + strlen("video_"), &end, 10);
+    if (end == pad_name + strlen("video_") || *end != '\0' || handle >= (guint64)FrameSink::MAX_STREAMS)
+        return -1;
+    return (int)handle;
 }
 
 GstFlowReturn GstAVPipeline::on_new_sample(GstAppSink* appsink, gpointer user_data)
@@ -104,130 +93,412 @@ GstFlowReturn GstAVPipeline::on_new_sample(GstAppSink* appsink, gpointer user_da
     if (!sample)
         return GST_FLOW_ERROR;
 
-    GstCaps* caps = gst_sample_get_caps(sample);
-    if (!caps)
+    if (!gst_sample_get_caps(sample))
     {
         gst_sample_unref(sample);
         Debug::Log("Sample without caps", Level::Error);
         return GST_FLOW_ERROR;
     }
 
-    std::lock_guard<std::mutex> lk(data->lock);
+    if (data->stream == 0)
+        data->avpipeline->_timeline.Mark(ConnectionTimeline::FirstSampleLeft);
+    else if (data->stream == 1)
+        data->avpipeline->_timeline.Mark(ConnectionTimeline::FirstSampleRight);
 
-    /* Caps updated, recreate converter */
-    if (data->last_caps && !gst_caps_is_equal(data->last_caps, caps))
-        gst_clear_object(&data->conv);
+    sample = PresentTracker::Stamp(sample, GST_ELEMENT(appsink));
+    data->leases.Publish(sample);
+    /* Never blocks: a sample not drawn yet is replaced by the newer one */
+    data->mailbox.Push(sample);
 
-    if (!data->conv)
-    {
-        Debug::Log("Create new converter");
-        GstVideoInfo in_info;
-        gst_video_info_from_caps(&in_info, caps);
-
-        /* In case of shared texture, video processor might not behave as expected.
-         * Use only pixel shader */
-        auto config = gst_structure_new("converter-config", GST_D3D11_CONVERTER_OPT_BACKEND, GST_TYPE_D3D11_CONVERTER_BACKEND,
-                                        GST_D3D11_CONVERTER_BACKEND_SHADER, nullptr);
+    return GST_FLOW_OK;
+}
 
-        data->conv = gst_d3d11_converter_new(data->avpipeline->_device, &in_info, &data->avpipeline->_render_info, config);
-    }
+/* Ring output: waits for room like a device sink would, so the audio queue upstream stays the playout buffer.
+ * If the reader stalls for longer than the ring lasts, the rest of the buffer is dropped. The wait also ends as soon
+ * as the sink flushes or the pipeline is being destroyed, so that a stalled reader does not hold the state change. */
+GstFlowReturn GstAVPipeline::on_new_audio_sample(GstAppSink* appsink, gpointer user_data)
+{
+    GstAVPipeline* avpipeline = static_cast<GstAVPipeline*>(user_data);
+    PcmRingBuffer& ring = avpipeline->_audio_ring;
 
-    gst_caps_replace(&data->last_caps, caps);
-    gst_clear_sample(&data->last_sample);
-    data->last_sample = sample;
+    GstSample* sample = gst_app_sink_pull_sample(appsink);
+    if (sample == nullptr)
+        return GST_FLOW_ERROR;
 
+    GstMapInfo map;
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    if (buffer != nullptr && gst_buffer_map(buffer, &map, GST_MAP_READ))
+    {
+        const float* samples = reinterpret_cast<const float*>(map.data);
+        const gsize count = map.size / sizeof(float);
+        const gint64 rate = (gint64)avpipeline->_audio_ring_rate.load() * avpipeline->_audio_ring_channels.load();
+        const gint64 deadline = g_get_monotonic_time() + ring.Get(PcmRingBuffer::CapacitySamples) * G_USEC_PER_SEC / rate;
+
+        GstPad* pad = GST_BASE_SINK_PAD(appsink);
+        gsize written = ring.Write(samples, count);
+        while (written < count && g_get_monotonic_time() < deadline && !avpipeline->_audio_ring_stopping &&
+               !GST_PAD_IS_FLUSHING(pad))
+        {
+            g_usleep(1000);
+            written += ring.Write(samples + written, count - written);
+        }
+        if (written < count)
+            ring.Drop(count - written);
+        gst_buffer_unmap(buffer, &map);
+    }
+    gst_sample_unref(sample);
     return GST_FLOW_OK;
 }
 
-void GstAVPipeline::Draw(bool left)
+void GstAVPipeline::Draw(int stream)
 {
-    AppData* data;
-    if (left)
-        data = _leftData.get();
-    else
-        data = _rightData.get();
-
+    AppData* data = get_stream(stream);
     if (data == nullptr)
     {
         Debug::Log("data is null", Level::Warning);
         return;
     }
 
-    GstSample* sample = nullptr;
-
-    /* Steal sample pointer */
-    std::lock_guard<std::mutex> lk(data->lock);
     /* If there's no updated sample, don't need to render again */
-    if (!data->last_sample)
-        return;
+    GstSample* sample = data->mailbox.Take();
+    present(&stream, &sample, sample ? 1 : 0, 1u << stream);
+}
 
-    sample = data->last_sample;
-    data->last_sample = nullptr;
+int GstAVPipeline::take_stereo(int* streams, GstSample** samples)
+{
+    AppData* left_data = get_stream(0);
+    AppData* right_data = get_stream(1);
+    GstSample* left = nullptr;
+    GstSample* right = nullptr;
+    /* A paused eye sends nothing: the other one is shown alone without waiting for a partner */
+    if (!_pairer.IsEnabled() || left_data == nullptr || right_data == nullptr || left_data->gate.IsPaused() ||
+        right_data->gate.IsPaused())
+    {
+        _pairer.Clear();
+        left = left_data ? left_data->mailbox.Take() : nullptr;
+        right = right_data ? right_data->mailbox.Take() : nullptr;
+    }
+    else
+    {
+        _pairer.Update(left_data->mailbox.Take(), right_data->mailbox.Take(), &left, &right);
+    }
 
-    auto buf = gst_sample_get_buffer(sample);
-    if (!buf)
+    int count = 0;
+    if (left)
     {
-        Debug::Log("Sample without buffer", Level::Error);
-        gst_sample_unref(sample);
-        return;
+        streams[count] = 0;
+        samples[count++] = left;
+    }
+    if (right)
+    {
+        streams[count] = 1;
+        samples[count++] = right;
     }
+    return count;
+}
 
-    data->keyed_mutex->ReleaseSync(0);
-    /* Converter will take gst_d3d11_device_lock() and acquire sync */
-    gst_d3d11_converter_convert_buffer(data->conv, buf, data->shared_buffer);
-    data->keyed_mutex->AcquireSync(0, INFINITE);
-    gst_sample_unref(sample);
+void GstAVPipeline::DrawStereo()
+{
+    int streams[2];
+    GstSample* samples[2];
+    present(streams, samples, take_stereo(streams, samples), 0x3);
 }
 
-GstElement* GstAVPipeline::add_rtph264depay(GstElement* pipeline)
+void GstAVPipeline::DrawAll()
 {
-    GstElement* rtph264depay = gst_element_factory_make("rtph264depay", nullptr);
-    if (!rtph264depay)
+    int streams[FrameSink::MAX_STREAMS];
+    GstSample* samples[FrameSink::MAX_STREAMS];
+    int count = take_stereo(streams, samples);
+    unsigned int drawn_mask = 0x3;
+    for (int stream = 2; stream < FrameSink::MAX_STREAMS; stream++)
     {
-        Debug::Log("Failed to create rtph264depay", Level::Error);
-        return nullptr;
+        AppData* data = get_stream(stream);
+        if (data == nullptr || !data->displayed.load(std::memory_order_relaxed))
+            continue;
+        drawn_mask |= 1u << stream;
+        GstSample* sample = data->mailbox.Take();
+        if (sample)
+        {
+            streams[count] = stream;
+            samples[count++] = sample;
+        }
     }
-    gst_bin_add(GST_BIN(pipeline), rtph264depay);
-    return rtph264depay;
+    present(streams, samples, count, drawn_mask);
 }
 
-GstElement* GstAVPipeline::add_h264parse(GstElement* pipeline)
+void GstAVPipeline::present(int* streams, GstSample** samples, int count, unsigned int drawn_mask)
 {
-    GstElement* h264parse = gst_element_factory_make("h264parse", nullptr);
-    if (!h264parse)
+    /* Streams are drawn together, so that the sink can convert them concurrently */
+    int valid = 0;
+    for (int i = 0; i < count; i++)
     {
-        Debug::Log("Failed to create h264parse", Level::Error);
-        return nullptr;
+        if (!gst_sample_get_buffer(samples[i]))
+        {
+            Debug::Log("Sample without buffer", Level::Error);
+            gst_sample_unref(samples[i]);
+            continue;
+        }
+        streams[valid] = streams[i];
+        samples[valid++] = samples[i];
+    }
+    /* Streams the sink actually wrote, a missing target or a failed conversion leaves the previous frame */
+    const unsigned int written = valid > 0 ? _sink->DrawBatch(streams, samples, valid) : 0;
+
+    /* A sample the sink could not write is not presented: the stream records no new frame instead */
+    for (int i = 0; i < valid; i++)
+    {
+        const bool presented = (written & (1u << streams[i])) != 0;
+        AppData* data = presented ? get_stream(streams[i]) : nullptr;
+        if (data != nullptr)
+            _av_sync.OnVideoPresented(data->presents.OnPresented(samples[i]));
+        gst_sample_unref(samples[i]);
+        if (!presented)
+            continue;
+        drawn_mask &= ~(1u << streams[i]);
+        if (streams[i] == 0)
+            _timeline.Mark(ConnectionTimeline::FirstDrawLeft);
+        else if (streams[i] == 1)
+            _timeline.Mark(ConnectionTimeline::FirstDrawRight);
+    }
+
+    for (int stream = 0; drawn_mask != 0; stream++, drawn_mask >>= 1)
+    {
+        AppData* data = (drawn_mask & 1) ? get_stream(stream) : nullptr;
+        if (data != nullptr)
+            data->presents.OnNoFrame();
     }
-    gst_bin_add(GST_BIN(pipeline), h264parse);
-    return h264parse;
 }
 
-GstElement* GstAVPipeline::add_d3d11h264dec(GstElement* pipeline)
+void GstAVPipeline::GetConnectionTimeline(gint64* elapsed, int count)
 {
-    GstElement* d3d11h264dec = gst_element_factory_make("d3d11h264dec", nullptr);
-    if (!d3d11h264dec)
+    for (int i = 0; i < count; i++)
     {
-        Debug::Log("Failed to create d3d11h264dec", Level::Error);
-        return nullptr;
+        elapsed[i] = i < ConnectionTimeline::MilestoneCount
+                         ? _timeline.GetElapsed(static_cast<ConnectionTimeline::Milestone>(i))
+                         : -1;
     }
-    gst_bin_add(GST_BIN(pipeline), d3d11h264dec);
-    return d3d11h264dec;
 }
 
-GstElement* GstAVPipeline::add_d3d11convert(GstElement* pipeline)
+std::string GstAVPipeline::GetLatencyReport()
+{
+    const std::string jitter = _jitter.Report();
+    return jitter.empty() ? _timeline.Report() : _timeline.Report() + "\n" + jitter;
+}
+
+void GstAVPipeline::SetJitterLatencyConfig(const JitterLatencyController::Config& config) { _jitter.Configure(config); }
+
+std::vector<JitterLatencyController::StreamStats> GstAVPipeline::GetJitterLatencyStats() { return _jitter.GetStats(); }
+
+void GstAVPipeline::SetAudioPlayoutConfig(const AudioPlayoutController::Config& config)
+{
+    {
+        std::lock_guard<std::mutex> lk(_av_sync_lock);
+        _playout_config = config;
+    }
+    apply_av_sync();
+}
+
+void GstAVPipeline::GetAudioPlayoutStats(gint64* values, int count)
+{
+    for (int i = 0; i < count && i < AudioPlayoutController::StatCount; i++)
+        values[i] = _playout.Get(static_cast<AudioPlayoutController::Stat>(i));
+}
+
+void GstAVPipeline::SetAudioSink(AudioSinkKind kind) { _audio_sink_kind = kind; }
+
+void GstAVPipeline::SetAudioRingFormat(gint rate, gint channels, guint capacity_ms)
+{
+    _audio_ring_rate = rate;
+    _audio_ring_channels = channels;
+    _audio_ring.SetCapacity((gsize)rate * channels * capacity_ms / 1000);
+}
+
+gsize GstAVPipeline::ReadAudio(float* samples, gsize count) { return _audio_ring.Read(samples, count); }
+
+void GstAVPipeline::GetAudioRingStats(gint64* values, int count)
+{
+    for (int i = 0; i < count && i < PcmRingBuffer::StatCount; i++)
+        values[i] = _audio_ring.Get(static_cast<PcmRingBuffer::Stat>(i));
+}
+
+void GstAVPipeline::GetAudioLossStats(guint64* values, int count)
+{
+    for (int i = 0; i < count && i < OpusLossTracker::CounterCount; i++)
+        values[i] = _audio_loss.Get(static_cast<OpusLossTracker::Counter>(i));
+}
+
+void GstAVPipeline::SetAvSyncMode(AvSyncMode mode)
 {
-    GstElement* d3d11convert = gst_element_factory_make("d3d11convert", nullptr);
-    if (!d3d11convert)
     {
-        Debug::Log("Failed to create d3d11convert", Level::Error);
+        std::lock_guard<std::mutex> lk(_av_sync_lock);
+        _av_sync_mode = mode;
+    }
+    Debug::Log(std::string("A/V sync mode: ") + (mode == AvSyncMode::Synced ? "synced" : "low latency"), Level::Info);
+    apply_av_sync();
+}
+
+void GstAVPipeline::GetAvSyncStats(gint64* values, int count)
+{
+    for (int i = 0; i < count && i < AvSyncMonitor::StatCount; i++)
+        values[i] = _av_sync.Get(static_cast<AvSyncMonitor::Stat>(i));
+}
+
+bool GstAVPipeline::is_av_synced()
+{
+    std::lock_guard<std::mutex> lk(_av_sync_lock);
+    return _av_sync_mode == AvSyncMode::Synced;
+}
+
+/* Synced: every sink waits for the clock time of its buffers, rtpbin having aligned the running times of the
+ * streams from the RTCP sender reports. Low latency: video is drawn once decoded, the audio queue level is held
+ * by the playout controller. */
+void GstAVPipeline::apply_av_sync()
+{
+    std::lock_guard<std::mutex> lk(_av_sync_lock);
+    const bool synced = _av_sync_mode == AvSyncMode::Synced;
+    AudioPlayoutController::Config config = _playout_config;
+    config.enabled = config.enabled && !synced;
+    _playout.Configure(config);
+
+    std::lock_guard<std::mutex> branches_lk(_branches_lock);
+    for (auto& branch : _active_branches)
+    {
+        if (g_str_has_prefix(branch.key.c_str(), "video/"))
+            g_object_set(branch.sink, "sync", synced, nullptr);
+    }
+}
+
+void GstAVPipeline::SetStereoPairing(bool enabled, StereoPairer::LatePolicy policy, gint64 max_wait_us,
+                                     GstClockTime tolerance)
+{
+    _pairer.Configure(enabled, policy, max_wait_us, tolerance);
+}
+
+void GstAVPipeline::EnableFrameLeases(int stream, bool enabled)
+{
+    AppData* data = register_stream(stream);
+    if (data != nullptr)
+        data->leases.SetEnabled(enabled);
+}
+
+bool GstAVPipeline::AcquireFrameLease(int stream, FrameLeaseInfo* info)
+{
+    AppData* data = get_stream(stream);
+    return data != nullptr && data->leases.Acquire(info);
+}
+
+void GstAVPipeline::ReleaseFrameLease(void* handle) { FrameLeases::Release(handle); }
+
+void GstAVPipeline::SetStreamPaused(int stream, bool paused)
+{
+    AppData* data = register_stream(stream);
+    if (data != nullptr)
+        data->gate.SetPaused(paused);
+}
+
+void GstAVPipeline::SetKeyframeRequestInterval(gint64 min_interval_us, gint64 max_interval_us)
+{
+    _keyframe_min_interval_us = min_interval_us;
+    _keyframe_max_interval_us = max_interval_us;
+    for (int stream = 0; stream < FrameSink::MAX_STREAMS; stream++)
+    {
+        AppData* data = get_stream(stream);
+        if (data != nullptr)
+            data->keyframes.Configure(min_interval_us, max_interval_us);
+    }
+}
+
+void GstAVPipeline::GetKeyframeStats(int stream, guint64* values, int count)
+{
+    AppData* data = get_stream(stream);
+    for (int i = 0; i < count; i++)
+    {
+        values[i] = data != nullptr && i < KeyframeRequester::CounterCount
+                        ? data->keyframes.Get(static_cast<KeyframeRequester::Counter>(i))
+                        : 0;
+    }
+}
+
+void GstAVPipeline::AddConverterPrewarm(unsigned int width, unsigned int height)
+{
+    _sink->AddPrewarmResolution(width, height);
+}
+
+void GstAVPipeline::SetOutputConfig(int stream, const OutputConfig& config) { _sink->SetOutputConfig(stream, config); }
+
+void GstAVPipeline::SetConversionThreads(unsigned int count) { _sink->SetThreadCount(count); }
+
+void GstAVPipeline::GetTextureSize(int stream, unsigned int* width, unsigned int* height)
+{
+    _sink->GetTargetSize(stream, width, height);
+}
+
+void GstAVPipeline::GetStereoPairStats(guint64* matched, guint64* mismatched)
+{
+    *matched = _pairer.GetMatched();
+    *mismatched = _pairer.GetMismatched();
+}
+
+void GstAVPipeline::GetFrameStats(int stream, guint64* received, guint64* presented, guint64* overwritten)
+{
+    AppData* data = get_stream(stream);
+    if (data == nullptr)
+    {
+        *received = *presented = *overwritten = 0;
+        return;
+    }
+
+    *received = data->mailbox.GetReceived();
+    *presented = data->mailbox.GetTaken();
+    *overwritten = data->mailbox.GetOverwritten();
+}
+
+bool GstAVPipeline::GetPresentInfo(int stream, PresentInfo* info)
+{
+    AppData* data = get_stream(stream);
+    if (data == nullptr)
+        return false;
+    *info = data->presents.Get();
+    return true;
+}
+
+int GstAVPipeline::GetCaptureLatencyHistogram(int stream, guint64* buckets, int count)
+{
+    AppData* data = get_stream(stream);
+    return data != nullptr ? data->presents.GetCaptureLatency().GetBuckets(buckets, count) : 0;
+}
+
+void GstAVPipeline::GetCaptureLatencyStats(int stream, gint64* values, int count)
+{
+    AppData* data = get_stream(stream);
+    for (int i = 0; i < count; i++)
+    {
+        values[i] = data != nullptr && i < LatencyHistogram::StatCount
+                        ? data->presents.GetCaptureLatency().Get(static_cast<LatencyHistogram::Stat>(i))
+                        : 0;
+    }
+}
+
+void GstAVPipeline::ResetCaptureLatency(int stream)
+{
+    AppData* data = get_stream(stream);
+    if (data != nullptr)
+        data->presents.GetCaptureLatency().Clear();
+}
+
+GstElement* GstAVPipeline::add_element(GstElement* pipeline, GstElementFactory* factory)
+{
+    GstElement* element = gst_element_factory_create(factory, nullptr);
+    if (!element)
+    {
+        Debug::Log(std::string("Failed to create ") + GST_OBJECT_NAME(factory), Level::Error);
         return nullptr;
     }
-    gst_bin_add(GST_BIN(pipeline), d3d11convert);
-    return d3d11convert;
+    gst_bin_add(GST_BIN(pipeline), element);
+    return element;
 }
 
-GstElement* GstAVPipeline::add_appsink(GstElement* pipeline)
+GstElement* GstAVPipeline::add_appsink(GstElement* pipeline, GstCaps* caps)
 {
     GstElement* appsink = gst_element_factory_make("appsink", nullptr);
     if (!appsink)
@@ -236,9 +507,7 @@ GstElement* GstAVPipeline::add_appsink(GstElement* pipeline)
         return nullptr;
     }
 
-    GstCaps* caps = gst_caps_from_string("video/x-raw(memory:D3D11Memory),format=RGBA");
     g_object_set(appsink, "caps", caps, "drop", true, "max-buffers", 1, "processing-deadline", 0, nullptr);
-    gst_caps_unref(caps);
 
     gst_bin_add(GST_BIN(pipeline), appsink);
     return appsink;
@@ -278,6 +547,8 @@ GstElement* GstAVPipeline::add_opusdec(GstElement* pipeline)
         Debug::Log("Failed to create opusdec", Level::Error);
         return nullptr;
     }
+    /* Lost packets come as GAP events: rebuilt from the FEC data of the next packet, or concealed */
+    g_object_set(opusdec, "use-inband-fec", TRUE, "plc", TRUE, nullptr);
 
     gst_bin_add(GST_BIN(pipeline), opusdec);
     return opusdec;
@@ -309,18 +580,14 @@ GstElement* GstAVPipeline::add_audioresample(GstElement* pipeline)
     return audioresample;
 }
 
-GstElement* GstAVPipeline::add_wasapi2sink(GstElement* pipeline)
+GstElement* GstAVPipeline::add_audiosink(GstElement* pipeline, AudioSinkKind kind)
 {
-    GstElement* wasapi2sink = gst_element_factory_make("wasapi2sink", nullptr);
-    if (!wasapi2sink)
-    {
-        Debug::Log("Failed to create wasapi2sink", Level::Error);
+    GstElement* audiosink = AudioPlayoutController::CreateSink(kind);
+    if (!audiosink)
         return nullptr;
-    }
-    g_object_set(wasapi2sink, "low-latency", true, "provide-clock", false, "processing-deadline", 0, nullptr);
 
-    gst_bin_add(GST_BIN(pipeline), wasapi2sink);
-    return wasapi2sink;
+    gst_bin_add(GST_BIN(pipeline), audiosink);
+    return audiosink;
 }
 
 GstElement* GstAVPipeline::add_webrtcsrc(GstElement* pipeline, const std::string& remote_peer_id, const std::string& uri,
@@ -339,6 +606,7 @@ GstElement* GstAVPipeline::add_webrtcsrc(GstElement* pipeline, const std::string
     {
         g_object_set(signaller, "producer-peer-id", remote_peer_id.c_str(), "uri", uri.c_str(), nullptr);
         g_signal_connect(G_OBJECT(signaller), "webrtcbin-ready", G_CALLBACK(webrtcbin_ready), self);
+        g_signal_connect(G_OBJECT(signaller), "session-started", G_CALLBACK(session_started), self);
         g_object_unref(signaller); // Unref signaller when done
     }
     else
@@ -354,100 +622,326 @@ GstElement* GstAVPipeline::add_webrtcsrc(GstElement* pipeline, const std::string
     return webrtcsrc;
 }
 
+bool GstAVPipeline::build_video_branch(const VideoDecodeChain& chain, DecodeBranch* branch)
+{
+    GstElement* bin = gst_bin_new(nullptr);
+    gst_object_ref_sink(bin);
+
+    GstElement* depay = add_element(bin, chain.depayloader);
+    GstElement* parse = chain.parser != nullptr ? add_element(bin, chain.parser) : nullptr;
+    GstElement* decoder = add_element(bin, chain.decoder);
+    GstElement* convert = _sink->add_video_convert(bin);
+    GstCaps* caps = _sink->get_appsink_caps();
+    GstElement* appsink = add_appsink(bin, caps);
+    gst_caps_unref(caps);
+
+    if (depay == nullptr || decoder == nullptr || appsink == nullptr)
+    {
+        gst_object_unref(bin);
+        return false;
+    }
+
+    /* Keep decoding through corrupted frames, the warnings trigger a keyframe request */
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(decoder), "max-errors") != nullptr)
+        g_object_set(decoder, "max-errors", -1, nullptr);
+
+    /* The parser is optional depending on the codec, the converter depending on the frame sink backend */
+    std::vector<GstElement*> elements = {depay};
+    if (parse != nullptr)
+        elements.push_back(parse);
+    elements.push_back(decoder);
+    if (convert != nullptr)
+        elements.push_back(convert);
+    elements.push_back(appsink);
+
+    for (size_t i = 1; i < elements.size(); i++)
+    {
+        if (!gst_element_link(elements[i - 1], elements[i]))
+        {
+            Debug::Log("Video elements could not be linked: " + std::string(GST_ELEMENT_NAME(elements[i - 1])) +
+                           " to " + GST_ELEMENT_NAME(elements[i]),
+                       Level::Error);
+            gst_object_unref(bin);
+            return false;
+        }
+    }
+
+    GstPad* sinkpad = gst_element_get_static_pad(depay, "sink");
+    gst_element_add_pad(bin, gst_ghost_pad_new("sink", sinkpad));
+    gst_object_unref(sinkpad);
+
+    branch->key = "video/" + chain.encoding_name;
+    branch->bin = bin;
+    branch->entry = depay;
+    branch->decoder = decoder;
+    branch->sink = appsink;
+    return true;
+}
+
+bool GstAVPipeline::build_audio_branch(DecodeBranch* branch)
+{
+    GstElement* bin = gst_bin_new(nullptr);
+    gst_object_ref_sink(bin);
+
+    GstElement* rtpopusdepay = add_rtpopusdepay(bin);
+    GstElement* queue = add_queue(bin);
+    GstElement* opusdec = add_opusdec(bin);
+    GstElement* audioconvert = add_audioconvert(bin);
+    GstElement* audioresample = add_audioresample(bin);
+    GstElement* audiosink = add_audiosink(bin, _audio_sink_kind.load());
+
+    if (!gst_element_link_many(rtpopusdepay, opusdec, queue, audioconvert, audioresample, audiosink, nullptr))
+    {
+        Debug::Log("Audio elements could not be linked.", Level::Error);
+        gst_object_unref(bin);
+        return false;
+    }
+
+    GstPad* sinkpad = gst_element_get_static_pad(rtpopusdepay, "sink");
+    gst_element_add_pad(bin, gst_ghost_pad_new("sink", sinkpad));
+    gst_object_unref(sinkpad);
+
+    branch->key = "audio/OPUS";
+    branch->bin = bin;
+    branch->entry = rtpopusdepay;
+    branch->decoder = opusdec;
+    branch->sink = audiosink;
+    return true;
+}
+
+/* Builds the branches of a stereo H264 stream with audio ahead of time and keeps them in READY,
+ * so that the first connection only has to link them */
+void GstAVPipeline::prepare_branches()
+{
+    const gint64 start = g_get_monotonic_time();
+
+    const VideoDecodeChain* chain = _decoders.Select("H264", *_sink);
+    while (chain != nullptr && _branch_pool.Count("video/" + chain->encoding_name) < 2)
+    {
+        DecodeBranch branch;
+        if (!build_video_branch(*chain, &branch))
+            break;
+        _sink->SetContext(branch.bin);
+        _branch_pool.Release(std::move(branch));
+    }
+
+    while (_branch_pool.Count("audio/OPUS") < 1)
+    {
+        DecodeBranch branch;
+        if (!build_audio_branch(&branch))
+            break;
+        _branch_pool.Release(std::move(branch));
+    }
+
+    Debug::Log("Decode branches prepared in " + std::to_string(g_get_monotonic_time() - start) + "us");
+}
+
+void GstAVPipeline::activate_branch(GstPad* pad, DecodeBranch branch)
+{
+    /* The pipeline holds its own reference, ours is given back to the pool when the pipeline stops */
+    gst_bin_add(GST_BIN(pipeline_), branch.bin);
+
+    GstPad* sinkpad = gst_element_get_static_pad(branch.bin, "sink");
+    if (gst_pad_link(pad, sinkpad) != GST_PAD_LINK_OK)
+    {
+        Debug::Log("Could not link dynamic pad to " + branch.key + " branch", Level::Error);
+    }
+    gst_object_unref(sinkpad);
+    gst_element_sync_state_with_parent(branch.bin);
+
+    std::lock_guard<std::mutex> lk(_branches_lock);
+    _active_branches.push_back(std::move(branch));
+}
+
 void GstAVPipeline::on_pad_added(GstElement* src, GstPad* new_pad, gpointer data)
 {
     GstAVPipeline* avpipeline = static_cast<GstAVPipeline*>(data);
 
     gchar* pad_name = gst_pad_get_name(new_pad);
+    const gint64 start = g_get_monotonic_time();
     Debug::Log("Adding pad ");
     if (g_str_has_prefix(pad_name, "video"))
     {
         Debug::Log("Adding video pad " + std::string(pad_name));
-        GstElement* rtph264depay = add_rtph264depay(avpipeline->pipeline_);
-        GstElement* h264parse = add_h264parse(avpipeline->pipeline_);
-        GstElement* d3d11h264dec = add_d3d11h264dec(avpipeline->pipeline_);
-        GstElement* d3d11convert = add_d3d11convert(avpipeline->pipeline_);
-        GstElement* appsink = add_appsink(avpipeline->pipeline_);
-
-        GstAppSinkCallbacks callbacks = {nullptr};
-        callbacks.new_sample = on_new_sample;
-
-        if (g_str_has_prefix(pad_name, "video_0"))
-        {
-            Debug::Log("Connecting left video pad " + std::string(pad_name));
-            gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &callbacks, avpipeline->_leftData.get(), nullptr);
-        }
-        else
+        const int stream = get_stream_handle(pad_name);
+        if (stream < 0)
         {
-            Debug::Log("Connecting right video pad " + std::string(pad_name));
-            gst_app_sink_set_callbacks(GST_APP_SINK(appsink), &callbacks, avpipeline->_rightData.get(), nullptr);
+            Debug::Log("No stream handle for video pad " + std::string(pad_name) + ", at most " +
+                           std::to_string(FrameSink::MAX_STREAMS) + " streams",
+                       Level::Error);
+            g_free(pad_name);
+            return;
         }
 
-        if (!gst_element_link_many(rtph264depay, h264parse, d3d11h264dec, d3d11convert, appsink, nullptr))
+        const std::string encoding_name = VideoDecoderSelector::get_encoding_name(new_pad);
+        const VideoDecodeChain* chain = avpipeline->_decoders.Select(encoding_name, *avpipeline->_sink);
+        if (chain == nullptr)
         {
-            Debug::Log("Elements could not be linked.");
+            Debug::Log("Cannot decode " + encoding_name + " video pad " + std::string(pad_name), Level::Error);
+            g_free(pad_name);
+            return;
         }
 
-        GstPad* sinkpad = gst_element_get_static_pad(rtph264depay, "sink");
-        if (gst_pad_link(new_pad, sinkpad) != GST_PAD_LINK_OK)
+        DecodeBranch branch;
+        const bool reused = avpipeline->_branch_pool.Acquire("video/" + encoding_name, &branch);
+        if (!reused && !avpipeline->build_video_branch(*chain, &branch))
         {
-            Debug::Log("Could not link dynamic video pad to rtph264depay", Level::Error);
+            Debug::Log("Cannot build video branch for " + std::string(pad_name), Level::Error);
+            g_free(pad_name);
+            return;
         }
-        gst_object_unref(sinkpad);
-        gst_element_sync_state_with_parent(rtph264depay);
-        gst_element_sync_state_with_parent(h264parse);
-        gst_element_sync_state_with_parent(d3d11h264dec);
-        gst_element_sync_state_with_parent(d3d11convert);
-        gst_element_sync_state_with_parent(appsink);
+
+        GstAppSinkCallbacks callbacks = {nullptr};
+        callbacks.new_sample = on_new_sample;
+
+        Debug::Log("Connecting video pad " + std::string(pad_name) + " to stream " + std::to_string(stream));
+        AppData* appdata = avpipeline->register_stream(stream);
+        if (stream == 0)
+            avpipeline->_timeline.Mark(ConnectionTimeline::VideoPadAddedLeft);
+        else if (stream == 1)
+            avpipeline->_timeline.Mark(ConnectionTimeline::VideoPadAddedRight);
+        gst_app_sink_set_callbacks(GST_APP_SINK(branch.sink), &callbacks, appdata, nullptr);
+        g_object_set(branch.sink, "sync", avpipeline->is_av_synced(), nullptr);
+        appdata->keyframes.Attach(branch.entry);
+        appdata->gate.Attach(branch.entry, branch.decoder);
+
+        avpipeline->activate_branch(new_pad, std::move(branch));
+
+        Debug::Log(std::string(reused ? "Reused" : "Built") + " video branch in " +
+                   std::to_string(g_get_monotonic_time() - start) + "us");
     }
     else if (g_str_has_prefix(pad_name, "audio"))
     {
         Debug::Log("Adding audio pad " + std::string(pad_name));
-        GstElement* rtpopusdepay = add_rtpopusdepay(avpipeline->pipeline_);
-        GstElement* queue = add_queue(avpipeline->pipeline_);
-        GstElement* opusdec = add_opusdec(avpipeline->pipeline_);
-        GstElement* audioconvert = add_audioconvert(avpipeline->pipeline_);
-        GstElement* audioresample = add_audioresample(avpipeline->pipeline_);
-        GstElement* wasapi2sink = add_wasapi2sink(avpipeline->pipeline_);
-
-        if (!gst_element_link_many(rtpopusdepay, opusdec, queue, audioconvert, audioresample, wasapi2sink, nullptr))
+        avpipeline->_timeline.Mark(ConnectionTimeline::AudioPadAdded);
+
+        DecodeBranch branch;
+        bool reused = avpipeline->_branch_pool.Acquire("audio/OPUS", &branch);
+        if (reused && !AudioPlayoutController::IsSinkKind(branch.sink, avpipeline->_audio_sink_kind.load()))
         {
-            Debug::Log("Audio elements could not be linked.", Level::Error);
+            /* Built before SetAudioSink */
+            DecodeBranchPool::destroy(branch);
+            reused = false;
+        }
+        if (!reused && !avpipeline->build_audio_branch(&branch))
+        {
+            Debug::Log("Cannot build audio branch for " + std::string(pad_name), Level::Error);
+            g_free(pad_name);
+            return;
         }
 
-        GstPad* sinkpad = gst_element_get_static_pad(rtpopusdepay, "sink");
-        if (gst_pad_link(new_pad, sinkpad) != GST_PAD_LINK_OK)
+        if (AudioPlayoutController::IsSinkKind(branch.sink, AudioSinkKind::Ring))
         {
-            Debug::Log("Could not link dynamic audio pad to rtpopusdepay", Level::Error);
+            GstCaps* caps = gst_caps_new_simple("audio/x-raw", "format", G_TYPE_STRING, "F32LE", "layout", G_TYPE_STRING,
+                                                "interleaved", "rate", G_TYPE_INT, avpipeline->_audio_ring_rate.load(),
+                                                "channels", G_TYPE_INT, avpipeline->_audio_ring_channels.load(), nullptr);
+            g_object_set(branch.sink, "caps", caps, nullptr);
+            gst_caps_unref(caps);
+
+            GstAppSinkCallbacks callbacks = {nullptr};
+            callbacks.new_sample = on_new_audio_sample;
+            gst_app_sink_set_callbacks(GST_APP_SINK(branch.sink), &callbacks, avpipeline, nullptr);
         }
-        gst_object_unref(sinkpad);
 
-        gst_element_sync_state_with_parent(rtpopusdepay);
-        gst_element_sync_state_with_parent(opusdec);
-        gst_element_sync_state_with_parent(queue);
-        gst_element_sync_state_with_parent(audioconvert);
-        gst_element_sync_state_with_parent(audioresample);
-        gst_element_sync_state_with_parent(wasapi2sink);
+        GstPad* audio_sinkpad = gst_element_get_static_pad(branch.sink, "sink");
+        gst_pad_add_probe(audio_sinkpad, GST_PAD_PROBE_TYPE_BUFFER, first_audio_buffer_probe, avpipeline, nullptr);
+        gst_object_unref(audio_sinkpad);
+
+        /* The playout queue is the one after the decoder */
+        GstPad* decoder_srcpad = gst_element_get_static_pad(branch.decoder, "src");
+        GstPad* queue_sinkpad = gst_pad_get_peer(decoder_srcpad);
+        GstElement* queue = gst_pad_get_parent_element(queue_sinkpad);
+        avpipeline->_playout.Attach(queue, branch.sink);
+        avpipeline->_av_sync.Attach(avpipeline->pipeline_, branch.sink);
+        avpipeline->_audio_loss.Attach(branch.decoder);
+        gst_object_unref(queue);
+        gst_object_unref(queue_sinkpad);
+        gst_object_unref(decoder_srcpad);
+
+        avpipeline->activate_branch(new_pad, std::move(branch));
+
+        Debug::Log(std::string(reused ? "Reused" : "Built") + " audio branch in " +
+                   std::to_string(g_get_monotonic_time() - start) + "us");
     }
     g_free(pad_name);
 }
 
+GstPadProbeReturn GstAVPipeline::first_audio_buffer_probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata)
+{
+    GstAVPipeline* avpipeline = static_cast<GstAVPipeline*>(udata);
+    avpipeline->_timeline.Mark(ConnectionTimeline::FirstAudioBuffer);
+    return GST_PAD_PROBE_REMOVE;
+}
+
+void GstAVPipeline::session_started(GObject* signaller, gchararray session_id, gchararray peer_id, gpointer udata)
+{
+    GstAVPipeline* avpipeline = static_cast<GstAVPipeline*>(udata);
+    Debug::Log("Signalling session started with " + std::string(peer_id), Level::Info);
+    avpipeline->_timeline.Mark(ConnectionTimeline::SignallerConnected);
+}
+
 void GstAVPipeline::webrtcbin_ready(GstElement* self, gchararray peer_id, GstElement* webrtcbin, gpointer udata)
 {
+    GstAVPipeline* avpipeline = static_cast<GstAVPipeline*>(udata);
+    avpipeline->_timeline.Mark(ConnectionTimeline::WebrtcbinReady);
     Debug::Log("Configure webrtcbin", Level::Info);
-    g_object_set(webrtcbin, "latency", 1, nullptr);
+
+    /* Initial latency, then each jitterbuffer is driven by the controller */
+    const JitterLatencyController::Config config = avpipeline->_jitter.GetConfig();
+    g_object_set(webrtcbin, "latency", config.enabled ? config.min_ms : 1u, nullptr);
+    avpipeline->_jitter.Attach(webrtcbin);
+
+    /* NTP capture time of each frame, from the RTCP sender reports, for the capture to present latency */
+    GstElement* rtpbin = gst_bin_get_by_name(GST_BIN(webrtcbin), "rtpbin");
+    if (rtpbin != nullptr && g_object_class_find_property(G_OBJECT_GET_CLASS(rtpbin), "add-reference-timestamp-meta"))
+        g_object_set(rtpbin, "add-reference-timestamp-meta", TRUE, nullptr);
+    else
+        Debug::Log("No reference timestamp meta, capture latency is not measured", Level::Warning);
+    /* Without retransmission, lost packets are signalled downstream for the audio concealment */
+    if (rtpbin != nullptr)
+        g_object_set(rtpbin, "do-lost", TRUE, nullptr);
+    gst_clear_object(&rtpbin);
+
+    g_signal_connect(webrtcbin, "on-new-transceiver", G_CALLBACK(on_new_transceiver), nullptr);
 }
 
-void GstAVPipeline::ReleaseTexture(ID3D11Texture2D* texture)
+/* Answers useinbandfec=1 for Opus, so that the sender adds the FEC data the decoder uses on loss.
+ * A value already in the preferences is kept: the answer intersects them with the offer, a conflicting
+ * useinbandfec would reject the audio m-line. */
+void GstAVPipeline::on_new_transceiver(GstElement* webrtcbin, GstWebRTCRTPTransceiver* transceiver, gpointer udata)
 {
-    if (texture != nullptr)
-    {  
-        texture->Release();
-        texture = nullptr;        
+    GstCaps* preferences = nullptr;
+    g_object_get(transceiver, "codec-preferences", &preferences, nullptr);
+    if (preferences == nullptr)
+    {
+        GstWebRTCKind kind = GST_WEBRTC_KIND_UNKNOWN;
+        g_object_get(transceiver, "kind", &kind, nullptr);
+        if (kind != GST_WEBRTC_KIND_AUDIO)
+            return;
+        preferences = gst_caps_new_simple("application/x-rtp", "media", G_TYPE_STRING, "audio", "encoding-name",
+                                          G_TYPE_STRING, "OPUS", "clock-rate", G_TYPE_INT, 48000, nullptr);
+    }
+
+    bool opus = false;
+    preferences = gst_caps_make_writable(preferences);
+    for (guint i = 0; i < gst_caps_get_size(preferences); i++)
+    {
+        GstStructure* structure = gst_caps_get_structure(preferences, i);
+        if (g_strcmp0(gst_structure_get_string(structure, "encoding-name"), "OPUS") == 0 &&
+            !gst_structure_has_field(structure, "useinbandfec"))
+        {
+            gst_structure_set(structure, "useinbandfec", G_TYPE_STRING, "1", nullptr);
+            opus = true;
+        }
     }
+    if (opus)
+        g_object_set(transceiver, "codec-preferences", preferences, nullptr);
+    gst_caps_unref(preferences);
 }
 
-GstAVPipeline::GstAVPipeline(IUnityInterfaces* s_UnityInterfaces) : GstBasePipeline("AVPipeline"), _s_UnityInterfaces(s_UnityInterfaces)
+void GstAVPipeline::ReleaseTexture(void* texture) { _sink->ReleaseTexture(texture); }
+
+GstAVPipeline::GstAVPipeline(IUnityInterfaces* s_UnityInterfaces) : GstBasePipeline("AVPipeline")
 {
     //preload plugins before Unity XR plugin
     preloaded_plugins.push_back(gst_plugin_load_by_name("rswebrtc"));
@@ -465,11 +959,13 @@ GstAVPipeline::GstAVPipeline(IUnityInterfaces* s_UnityInterfaces) : GstBasePipel
     {
         Debug::Log("Failed to load 'webrtcdsp' plugin", Level::Error);
     }
+#ifdef _WIN32
     preloaded_plugins.push_back(gst_plugin_load_by_name("d3d11"));
     if (!preloaded_plugins.back())
     {
         Debug::Log("Failed to load 'd3d11' plugin", Level::Error);
     }
+#endif
     preloaded_plugins.push_back(gst_plugin_load_by_name("rtpmanager"));
     if (!preloaded_plugins.back())
     {
@@ -480,11 +976,13 @@ GstAVPipeline::GstAVPipeline(IUnityInterfaces* s_UnityInterfaces) : GstBasePipel
     {
         Debug::Log("Failed to load 'opus' plugin", Level::Error);
     }
+#ifdef _WIN32
     preloaded_plugins.push_back(gst_plugin_load_by_name("wasapi2"));
     if (!preloaded_plugins.back())
     {
         Debug::Log("Failed to load 'wasapi2' plugin", Level::Error);
     }
+#endif
     preloaded_plugins.push_back(gst_plugin_load_by_name("dtls"));
     if (!preloaded_plugins.back())
     {
@@ -496,13 +994,28 @@ GstAVPipeline::GstAVPipeline(IUnityInterfaces* s_UnityInterfaces) : GstBasePipel
         Debug::Log("Failed to load 'srtp' plugin", Level::Error);
     }
 
-    _render_info = GstVideoInfo();
+    /* D3D11 when Unity renders with it, system memory otherwise (headless, Linux) */
+#ifdef _WIN32
+    if (s_UnityInterfaces != nullptr &&
+        s_UnityInterfaces->Get<IUnityGraphics>()->GetRenderer() == kUnityGfxRendererD3D11)
+        _sink = std::make_unique<D3D11FrameSink>(s_UnityInterfaces);
+    else
+#endif
+        _sink = std::make_unique<CpuFrameSink>();
+    Debug::Log(std::string("Frame sink backend: ") + _sink->GetName(), Level::Info);
+    SetAudioRingFormat(48000, 2, 60);
 }
 
 GstAVPipeline::~GstAVPipeline()
 {
-    gst_clear_object(&_device);
-    gst_object_unref(_device);
+    /* Release the decode branches and the sink (and its device) before the preloaded plugins */
+    for (auto& branch : _active_branches)
+        DecodeBranchPool::destroy(branch);
+    _active_branches.clear();
+    _branch_pool.Clear();
+    for (auto& stream : _streams)
+        delete stream.exchange(nullptr);
+    _sink = nullptr;
 
     for (auto& plugin : preloaded_plugins)
     {
@@ -517,63 +1030,115 @@ void GstAVPipeline::CreatePipeline(const char* uri, const char* remote_peer_id)
     Debug::Log(uri, Level::Info);
     Debug::Log(remote_peer_id, Level::Info);
 
+    _timeline.Reset();
+    _audio_ring_stopping = false;
     GstBasePipeline::CreatePipeline();
 
     GstElement* webrtcsrc = add_webrtcsrc(pipeline_, remote_peer_id, uri, this);
 
+    _jitter.Start(main_context_);
     CreateBusThread();
 }
 
 void GstAVPipeline::CreateDevice()
 {
-    if (_device == nullptr)
-    {
-        /* Find adapter LUID of render device, then create our device with the same
-         * adapter */
-        ComPtr<IDXGIDevice> dxgi_device;
-        auto hr = _s_UnityInterfaces->Get<IUnityGraphicsD3D11>()->GetDevice()->QueryInterface(IID_PPV_ARGS(&dxgi_device));
-        g_assert(SUCCEEDED(hr));
-
-        ComPtr<IDXGIAdapter> adapter;
-        hr = dxgi_device->GetAdapter(&adapter);
-        g_assert(SUCCEEDED(hr));
-
-        DXGI_ADAPTER_DESC adapter_desc;
-        hr = adapter->GetDesc(&adapter_desc);
-        g_assert(SUCCEEDED(hr));
+    _sink->CreateDevice();
+    prepare_branches();
+}
 
-        auto luid = gst_d3d11_luid_to_int64(&adapter_desc.AdapterLuid);
+void GstAVPipeline::DestroyPipeline()
+{
+    /* Before the state change, which waits for the streaming threads */
+    _audio_ring_stopping = true;
+    GstBasePipeline::DestroyPipeline();
+    
+    for (int stream = 0; stream < FrameSink::MAX_STREAMS; stream++)
+    {
+        AppData* data = get_stream(stream);
+        if (data == nullptr)
+            continue;
+
+        Debug::Log("Stream " + std::to_string(stream) + " video frames received: " + std::to_string(data->mailbox.GetReceived()) +
+                   ", presented: " + std::to_string(data->mailbox.GetTaken()) +
+                   ", overwritten: " + std::to_string(data->mailbox.GetOverwritten()));
+        Debug::Log("Keyframe requests: " + std::to_string(data->keyframes.Get(KeyframeRequester::Requests)) +
+                   ", suppressed: " + std::to_string(data->keyframes.Get(KeyframeRequester::Suppressed)) +
+                   ", recoveries: " + std::to_string(data->keyframes.Get(KeyframeRequester::Recoveries)) +
+                   ", last recovery: " + std::to_string(data->keyframes.Get(KeyframeRequester::LastRecoveryUs)) + "us");
+        const LatencyHistogram& capture = data->presents.GetCaptureLatency();
+        if (capture.Get(LatencyHistogram::Count) > 0)
+        {
+            Debug::Log("Capture to present latency: mean " + std::to_string(capture.Get(LatencyHistogram::Mean)) +
+                       "us, min " + std::to_string(capture.Get(LatencyHistogram::Min)) + "us, max " +
+                       std::to_string(capture.Get(LatencyHistogram::Max)) + "us over " +
+                       std::to_string(capture.Get(LatencyHistogram::Count)) + " frames");
+        }
+        data->mailbox.Clear();
+        data->leases.Clear();
+        data->presents.Clear();
+    }
 
-        /* This device will be used by our pipeline */
-        _device = gst_d3d11_device_new_for_adapter_luid(
-            luid, D3D11_CREATE_DEVICE_BGRA_SUPPORT /* | D3D11_CREATE_DEVICE_DEBUG*/);
-        g_assert(_device);
+    Debug::Log(_timeline.Report());
+    const std::string jitter = _jitter.Report();
+    if (!jitter.empty())
+        Debug::Log(jitter);
+    _jitter.Stop();
+    Debug::Log("Stereo pairs matched: " + std::to_string(_pairer.GetMatched()) +
+               ", mismatched: " + std::to_string(_pairer.GetMismatched()));
+    _pairer.Clear();
+    Debug::Log("Audio playout level: " + std::to_string(_playout.Get(AudioPlayoutController::LevelUs)) +
+               "us, correction: " + std::to_string(_playout.Get(AudioPlayoutController::CorrectionPpm)) +
+               "ppm, underruns: " + std::to_string(_playout.Get(AudioPlayoutController::Underruns)) +
+               ", overruns: " + std::to_string(_playout.Get(AudioPlayoutController::Overruns)));
+    if (_av_sync.Get(AvSyncMonitor::AudioSamples) > 0 && _av_sync.Get(AvSyncMonitor::VideoSamples) > 0)
+    {
+        Debug::Log("A/V offset: " + std::to_string(_av_sync.Get(AvSyncMonitor::OffsetUs)) + "us (audio " +
+                   std::to_string(_av_sync.Get(AvSyncMonitor::AudioLatencyUs)) + "us, video " +
+                   std::to_string(_av_sync.Get(AvSyncMonitor::VideoLatencyUs)) + "us from capture)");
     }
-    else
+    _av_sync.Reset();
+    Debug::Log("Audio packets received: " + std::to_string(_audio_loss.Get(OpusLossTracker::Received)) +
+               ", lost: " + std::to_string(_audio_loss.Get(OpusLossTracker::Lost)) +
+               ", recovered: " + std::to_string(_audio_loss.Get(OpusLossTracker::Recovered)) +
+               ", concealed: " + std::to_string(_audio_loss.Get(OpusLossTracker::Concealed)));
+    _audio_loss.Reset();
+    if (_audio_ring.Get(PcmRingBuffer::WrittenSamples) > 0)
     {
-        Debug::Log("Device already created", Level::Warning);
+        Debug::Log("Audio ring underruns: " + std::to_string(_audio_ring.Get(PcmRingBuffer::Underruns)) +
+                   ", samples dropped: " + std::to_string(_audio_ring.Get(PcmRingBuffer::Overruns)));
     }
+    _audio_ring.Clear();
+    _sink->Flush();
 }
 
-void GstAVPipeline::DestroyPipeline()
+void GstAVPipeline::OnPipelineStopped()
 {
-    GstBasePipeline::DestroyPipeline();
-    
-    if (_leftData != nullptr)
+    for (int stream = 0; stream < FrameSink::MAX_STREAMS; stream++)
     {
-        gst_clear_sample(&_leftData->last_sample);
-        gst_clear_caps(&_leftData->last_caps);
-        gst_clear_object(&_leftData->conv);
+        AppData* data = get_stream(stream);
+        if (data == nullptr)
+            continue;
+        data->gate.Detach();
+        data->keyframes.Detach();
     }
-    if (_rightData != nullptr)
+    _playout.Detach();
+    _av_sync.Detach();
+    _audio_loss.Detach();
+
+    /* Keep the decode branches for the next connection */
+    std::lock_guard<std::mutex> lk(_branches_lock);
+    for (auto& branch : _active_branches)
     {
-        gst_clear_sample(&_rightData->last_sample);
-        gst_clear_caps(&_rightData->last_caps);
-        gst_clear_object(&_rightData->conv);
+        GstObject* parent = gst_object_get_parent(GST_OBJECT(branch.bin));
+        if (parent != nullptr)
+        {
+            gst_element_set_state(branch.bin, GST_STATE_NULL);
+            gst_bin_remove(GST_BIN(parent), branch.bin);
+            gst_object_unref(parent);
+        }
+        _branch_pool.Release(std::move(branch));
     }
-
-    //pDebug->ReportLiveDeviceObjects(D3D11_RLDO_DETAIL | D3D11_RLDO_IGNORE_INTERNAL);
-    //pDebug = nullptr;
+    _active_branches.clear();
 }
 
 GstBusSyncReply GstAVPipeline::busSyncHandler(GstBus* bus, GstMessage* msg, gpointer user_data)
@@ -583,20 +1148,32 @@ GstBusSyncReply GstAVPipeline::busSyncHandler(GstBus* bus, GstMessage* msg, gpoi
     switch (GST_MESSAGE_TYPE(msg))
     {
         case GST_MESSAGE_NEED_CONTEXT:
+            self->_sink->OnNeedContext(msg);
+            break;
+        case GST_MESSAGE_WARNING:
+        case GST_MESSAGE_QOS:
         {
-            const gchar* ctx_type;
-            if (!gst_message_parse_context_type(msg, &ctx_type))
-                break;
-
-            /* non-d3d11 context message is not interested */
-            if (g_strcmp0(ctx_type, GST_D3D11_DEVICE_HANDLE_CONTEXT_TYPE) != 0)
-                break;
-
-            /* Pass our device to the message source element.
-             * Otherwise pipeline will create another device */
-            auto context = gst_d3d11_context_new(self->_device);
-            gst_element_set_context(GST_ELEMENT(msg->src), context);
-            gst_context_unref(context);
+            /* Decode errors are posted as warnings (max-errors is disabled on the decoders), other warnings of the
+             * branch do not tell about a broken picture.
+             * QoS messages need a sink synchronizing on the clock: the appsinks run with sync=false in low latency
+             * mode, so QoS triggered requests only happen in synced mode. */
+            const bool warning = GST_MESSAGE_TYPE(msg) == GST_MESSAGE_WARNING;
+            if (warning)
+            {
+                GError* err = nullptr;
+                gst_message_parse_warning(msg, &err, nullptr);
+                const bool decode_error = g_error_matches(err, GST_STREAM_ERROR, GST_STREAM_ERROR_DECODE);
+                g_clear_error(&err);
+                if (!decode_error)
+                    break;
+            }
+            const auto reason = warning ? KeyframeRequester::Reason::DecodeError : KeyframeRequester::Reason::Qos;
+            for (int stream = 0; stream < FrameSink::MAX_STREAMS; stream++)
+            {
+                AppData* data = self->get_stream(stream);
+                if (data != nullptr && data->keyframes.Owns(msg->src))
+                    data->keyframes.Request(reason);
+            }
             break;
         }
         default:
@@ -4,13 +4,28 @@
 
 #pragma once
 #include "Unity/IUnityInterface.h"
+#include "AudioPlayoutController.h"
+#include "AvSyncMonitor.h"
+#include "ConnectionTimeline.h"
+#include "DecodeBranchPool.h"
+#include "FrameLeases.h"
+#include "FrameMailbox.h"
+#include "FrameSink.h"
 #include "GstBasePipeline.h"
-#include <d3d11.h>
+#include "JitterLatencyController.h"
+#include "KeyframeRequester.h"
+#include "OpusLossTracker.h"
+#include "PcmRingBuffer.h"
+#include "PresentTracker.h"
+#include "StereoPairer.h"
+#include "StreamGate.h"
+#include "VideoDecoderSelector.h"
 #include <gst/app/app.h>
-#include <gst/d3d11/gstd3d11.h>
+#include <gst/webrtc/webrtc.h>
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <vector>
-#include <wrl.h>
 
 class GstAVPipeline : GstBasePipeline
 {
@@ -18,56 +33,153 @@ class GstAVPipeline : GstBasePipeline
 private:
     std::vector<GstPlugin*> preloaded_plugins;
 
-    GstD3D11Device* _device = nullptr;
+    std::unique_ptr<FrameSink> _sink = nullptr;
+    VideoDecoderSelector _decoders;
+
+    DecodeBranchPool _branch_pool;
+    std::mutex _branches_lock;
+    std::vector<DecodeBranch> _active_branches;
 
-    IUnityInterfaces* _s_UnityInterfaces = nullptr;
-    GstVideoInfo _render_info;
     struct AppData
     {
         GstAVPipeline* avpipeline = nullptr;
-        GstCaps* last_caps = nullptr;
-        std::mutex lock;
-        GstSample* last_sample = nullptr;
-        Microsoft::WRL::ComPtr<IDXGIKeyedMutex> keyed_mutex = nullptr;
-        GstBuffer* shared_buffer = nullptr;
-        GstD3D11Converter* conv = nullptr;
+        int stream = 0;
+        std::atomic<bool> displayed{false}; // a target was created for this stream
+        FrameMailbox mailbox;
+        FrameLeases leases;
+        PresentTracker presents;
+        KeyframeRequester keyframes;
+        StreamGate gate{keyframes};
     };
 
-    std::unique_ptr<AppData> _leftData = nullptr;
-    std::unique_ptr<AppData> _rightData = nullptr;
+    /* Stream registry, indexed by stream handle. An entry is created once, by CreateTexture or by the first pad
+     * of that stream, and lives as long as the pipeline object: lookups from the render thread are lock free. */
+    std::atomic<AppData*> _streams[FrameSink::MAX_STREAMS] = {};
+    std::atomic<gint64> _keyframe_min_interval_us{100000};
+    std::atomic<gint64> _keyframe_max_interval_us{2000000};
+
+    StereoPairer _pairer;
+    ConnectionTimeline _timeline;
+    JitterLatencyController _jitter;
+    AudioPlayoutController _playout;
+    AvSyncMonitor _av_sync;
+    OpusLossTracker _audio_loss;
+    std::mutex _av_sync_lock;
+    AvSyncMode _av_sync_mode = AvSyncMode::LowLatency;
+    AudioPlayoutController::Config _playout_config; // as set, disabled while synced
+    std::atomic<AudioSinkKind> _audio_sink_kind{AudioSinkKind::Device};
+    PcmRingBuffer _audio_ring;
+    std::atomic<gint> _audio_ring_rate{48000};
+    std::atomic<gint> _audio_ring_channels{2};
+    std::atomic<bool> _audio_ring_stopping{false}; // the ring sink no longer waits for room
 
 public:
     GstAVPipeline(IUnityInterfaces* s_UnityInterfaces);
     ~GstAVPipeline();
 
-    void Draw(bool left);
+    void Draw(int stream);
+    void DrawStereo();
+    // Stereo pair, then every other stream with a target
+    void DrawAll();
+    // Stops decoding the stream while it is not displayed, a keyframe is requested on resume
+    void SetStreamPaused(int stream, bool paused);
+    void SetKeyframeRequestInterval(gint64 min_interval_us, gint64 max_interval_us);
+    // Values in KeyframeRequester::Counter order
+    void GetKeyframeStats(int stream, guint64* values, int count);
+    void SetStereoPairing(bool enabled, StereoPairer::LatePolicy policy, gint64 max_wait_us, GstClockTime tolerance);
+    void GetStereoPairStats(guint64* matched, guint64* mismatched);
+    // Microseconds since CreatePipeline for each ConnectionTimeline milestone, -1 if not reached
+    void GetConnectionTimeline(gint64* elapsed, int count);
+    void GetFrameStats(int stream, guint64* received, guint64* presented, guint64* overwritten);
+    // Record of the last draw of the stream
+    bool GetPresentInfo(int stream, PresentInfo* info);
+    // Capture to present latency of the stream since the last reset, see LatencyHistogram
+    int GetCaptureLatencyHistogram(int stream, guint64* buckets, int count);
+    // Values in LatencyHistogram::Stat order
+    void GetCaptureLatencyStats(int stream, gint64* values, int count);
+    void ResetCaptureLatency(int stream);
+    void SetJitterLatencyConfig(const JitterLatencyController::Config& config);
+    std::vector<JitterLatencyController::StreamStats> GetJitterLatencyStats();
+    // Build the converters for this stream resolution ahead of the first frame at that size
+    void AddConverterPrewarm(unsigned int width, unsigned int height);
+    void SetOutputConfig(int stream, const OutputConfig& config);
+    void GetTextureSize(int stream, unsigned int* width, unsigned int* height);
+    // Threads converting frames in the system memory backend, 0 for one per core
+    void SetConversionThreads(unsigned int count);
+    void SetAudioPlayoutConfig(const AudioPlayoutController::Config& config);
+    // Values in AudioPlayoutController::Stat order
+    void GetAudioPlayoutStats(gint64* values, int count);
+    // Sink of the audio branches built from now on
+    void SetAudioSink(AudioSinkKind kind);
+    // Format of the AudioSinkKind::Ring output, capacity_ms bounds the latency the ring adds
+    void SetAudioRingFormat(gint rate, gint channels, guint capacity_ms);
+    // Unity audio thread, interleaved samples. Zero fills past the available ones, returns how many were available.
+    gsize ReadAudio(float* samples, gsize count);
+    // Values in PcmRingBuffer::Stat order
+    void GetAudioRingStats(gint64* values, int count);
+    // Audio packets of the current session, values in OpusLossTracker::Counter order
+    void GetAudioLossStats(guint64* values, int count);
+    // Applied to the running sinks
+    void SetAvSyncMode(AvSyncMode mode);
+    // Values in AvSyncMonitor::Stat order
+    void GetAvSyncStats(gint64* values, int count);
 
     void CreatePipeline(const char* uri, const char* remote_peer_id);
     void CreateDevice();
     void DestroyPipeline() override;
 
-    ID3D11Texture2D* CreateTexture(unsigned int width, unsigned int height, bool left = true);
-    void ReleaseTexture(ID3D11Texture2D* texture);
+    // CPU access to the latest decoded frame of a stream, without copy
+    void EnableFrameLeases(int stream, bool enabled);
+    bool AcquireFrameLease(int stream, FrameLeaseInfo* info);
+    void ReleaseFrameLease(void* handle);
+
+    void* CreateTexture(unsigned int width, unsigned int height, int stream);
+    void* GetTexturePtr(int stream);
+    // Both eyes in one target, drawn by DrawStereo / DrawAll in a single batch
+    void* CreateStereoTexture(unsigned int eye_width, unsigned int eye_height, StereoLayout layout);
+    void* GetStereoTexturePtr();
+    void ReleaseTexture(void* texture);
 
 private:
     static void on_pad_added(GstElement* src, GstPad* new_pad, gpointer data);
     static void webrtcbin_ready(GstElement* self, gchararray peer_id, GstElement* webrtcbin, gpointer udata);
+    static void on_new_transceiver(GstElement* webrtcbin, GstWebRTCRTPTransceiver* transceiver, gpointer udata);
+    static void session_started(GObject* signaller, gchararray session_id, gchararray peer_id, gpointer udata);
+    static GstPadProbeReturn first_audio_buffer_probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata);
     
-    static GstFlowReturn GstAVPipeline::on_new_sample(GstAppSink* appsink, gpointer user_data);
+    static GstFlowReturn on_new_sample(GstAppSink* appsink, gpointer user_data);
+    static GstFlowReturn on_new_audio_sample(GstAppSink* appsink, gpointer user_data);
+    // Draws and releases the samples, dropping the ones without buffer.
+    // Streams of the drawn mask without a sample written by the sink are recorded as not having a new frame.
+    void present(int* streams, GstSample** samples, int count, unsigned int drawn_mask);
+    // Takes the pending left / right samples (paired if enabled), returns how many were stored
+    int take_stereo(int* streams, GstSample** samples);
+
+    AppData* get_stream(int stream);
+    AppData* register_stream(int stream);
+    // Handle N of a "video_N" pad, -1 if the name does not match
+    static int get_stream_handle(const gchar* pad_name);
 
     GstBusSyncReply busSyncHandler(GstBus* bus, GstMessage* msg, gpointer user_data) override;
+    void OnPipelineStopped() override;
+    std::string GetLatencyReport() override;
+
+    void prepare_branches();
+    bool build_video_branch(const VideoDecodeChain& chain, DecodeBranch* branch);
+    bool build_audio_branch(DecodeBranch* branch);
+    void activate_branch(GstPad* pad, DecodeBranch branch);
+    // Sink clock sync and audio playout control for the current mode
+    void apply_av_sync();
+    bool is_av_synced();
 
-    static GstElement* add_rtph264depay(GstElement* pipeline);
-    static GstElement* add_h264parse(GstElement* pipeline);
-    static GstElement* add_d3d11h264dec(GstElement* pipeline);
-    static GstElement* add_d3d11convert(GstElement* pipeline);
-    static GstElement* add_appsink(GstElement* pipeline);
+    static GstElement* add_element(GstElement* pipeline, GstElementFactory* factory);
+    static GstElement* add_appsink(GstElement* pipeline, GstCaps* caps);
     static GstElement* add_rtpopusdepay(GstElement* pipeline);
     static GstElement* add_queue(GstElement* pipeline);
     static GstElement* add_opusdec(GstElement* pipeline);
     static GstElement* add_audioconvert(GstElement* pipeline);
     static GstElement* add_audioresample(GstElement* pipeline);
-    static GstElement* add_wasapi2sink(GstElement* pipeline);
+    static GstElement* add_audiosink(GstElement* pipeline, AudioSinkKind kind);
     static GstElement* add_webrtcsrc(GstElement* pipeline, const std::string& remote_peer_id, const std::string& uri,
                                      GstAVPipeline* self);
 };
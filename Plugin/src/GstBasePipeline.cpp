@@ -32,6 +32,8 @@ void GstBasePipeline::DestroyPipeline() {
         bus_thread_ = nullptr;
     }
 
+    OnPipelineStopped();
+
     if (pipeline_ != nullptr)
     {
         Debug::Log(PIPENAME + " pipeline released", Level::Info);
@@ -58,6 +60,7 @@ gpointer GstBasePipeline::main_loop_func(gpointer data)
     auto state = gst_element_set_state(self->pipeline_, GstState::GST_STATE_PLAYING);
     if (state == GstStateChangeReturn::GST_STATE_CHANGE_FAILURE)
     {
+        self->streaming_ = false;
         Debug::Log("Cannot set pipeline to playing state", Level::Error);
         gst_object_unref(self->pipeline_);
         self->pipeline_ = nullptr;
@@ -65,6 +68,7 @@ gpointer GstBasePipeline::main_loop_func(gpointer data)
     }
 
     g_main_loop_run(self->main_loop_);
+    self->streaming_ = false;
 
     gst_element_set_state(self->pipeline_, GST_STATE_NULL);
 
@@ -145,6 +149,10 @@ gboolean GstBasePipeline::dumpLatencyCallback(GstBasePipeline* self)
             Debug::Log(msg);
         }
         gst_query_unref(query);
+
+        const std::string report = self->GetLatencyReport();
+        if (!report.empty())
+            Debug::Log(report);
         return true;
     }
     return false;
@@ -153,9 +161,11 @@ gboolean GstBasePipeline::dumpLatencyCallback(GstBasePipeline* self)
 void GstBasePipeline::CreateBusThread()
 {
     const std::string name = "bus thread " + PIPENAME;
+    streaming_ = true;
     bus_thread_ = g_thread_new(name.c_str(), main_loop_func, this);
     if (!bus_thread_)
     {
+        streaming_ = false;
         Debug::Log("Failed to create GLib main thread", Level::Error);
     }
 }
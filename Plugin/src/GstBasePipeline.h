@@ -3,6 +3,7 @@
  LICENSE file in the root directory of this source tree. */
 
 #pragma once
+#include <atomic>
 #include <gst/gst.h>
 #include <string>
 
@@ -14,6 +15,8 @@ protected:
     GThread* bus_thread_ = nullptr;
     GMainContext* main_context_ = nullptr;
     GMainLoop* main_loop_ = nullptr;
+    // Set by CreateBusThread, cleared once the bus thread leaves its main loop (error, EOS or DestroyPipeline)
+    std::atomic<bool> streaming_{false};
 
 public:
     GstBasePipeline(const std::string& pipename);
@@ -27,6 +30,10 @@ protected:
     virtual GstBusSyncReply busSyncHandler(GstBus* bus, GstMessage* msg, gpointer user_data);
     static gboolean busHandler(GstBus* bus, GstMessage* msg, gpointer data);
     static gboolean dumpLatencyCallback(GstBasePipeline* self);
+    // Appended to the latency dump
+    virtual std::string GetLatencyReport() { return ""; }
 
     void CreateBusThread();
+    // Called once the bus thread is joined and the pipeline stopped, before the pipeline is released
+    virtual void OnPipelineStopped() {}
 };
\ No newline at end of file
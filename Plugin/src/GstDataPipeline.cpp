@@ -4,6 +4,7 @@
 
 #include "GstDataPipeline.h"
 #include "DebugLog.h"
+#include <cstring>
 #include <gst/sdp/sdp.h>
 #include <gst/webrtc/webrtc.h>
 
@@ -3,13 +3,12 @@
  LICENSE file in the root directory of this source tree. */
 
 #pragma once
+#include "DebugLog.h"
 #include "GstBasePipeline.h"
 #include <gst/gst.h>
 #include <gst/webrtc/datachannel.h>
 #include <string>
 
-#define DLLExport __declspec(dllexport)
-
 extern "C"
 {
     // Create a callback delegate
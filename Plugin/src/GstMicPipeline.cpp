@@ -9,13 +9,28 @@ GstMicPipeline::GstMicPipeline() : GstBasePipeline("MicPipeline") {}
 
 void GstMicPipeline::CreatePipeline(const char* uri, const char* remote_peer_id) 
 {
+    const Setup setup = get_setup(uri);
+    if (pipeline_ != nullptr || bus_thread_ != nullptr)
+    {
+        /* A pipeline stopped by an error or EOS is not worth keeping, nor one built for another source */
+        if (streaming_ && running_ == setup)
+        {
+            Debug::Log("GstMicPipeline kept warm", Level::Info);
+            return;
+        }
+        Debug::Log(streaming_ ? "GstMicPipeline setup changed, rebuild" : "GstMicPipeline stopped, rebuild",
+                   Level::Info);
+        DestroyPipeline();
+    }
+
     Debug::Log("GstMicPipeline create pipeline", Level::Info);
     Debug::Log(uri, Level::Info);
     Debug::Log(remote_peer_id, Level::Info);
 
     GstBasePipeline::CreatePipeline();
 
-    GstElement* wasapi2src = add_wasapi2src(pipeline_);
+    const bool unity = setup.source == MicSource::Unity;
+    GstElement* audiosrc = unity ? unity_source_.CreateSource(pipeline_) : add_audiosrc(pipeline_);
     GstElement* webrtcdsp = add_webrtcdsp(pipeline_);
     GstElement* audioconvert = add_audioconvert(pipeline_);
     GstElement* queue = add_queue(pipeline_);
@@ -23,26 +38,118 @@ void GstMicPipeline::CreatePipeline(const char* uri, const char* remote_peer_id)
     GstElement* audio_caps_capsfilter = add_audio_caps_capsfilter(pipeline_);
     GstElement* webrtcsink = add_webrtcsink(pipeline_, uri);
 
-    if (!gst_element_link_many(wasapi2src, queue, audioconvert, webrtcdsp, opusenc, audio_caps_capsfilter, webrtcsink, nullptr))
+    /* Unity may run at a rate webrtcdsp does not take (44.1 kHz) */
+    GstElement* input = audiosrc;
+    if (unity)
+    {
+        input = add_audioresample(pipeline_);
+        if (!gst_element_link(audiosrc, input))
+            Debug::Log("Unity microphone source could not be linked.", Level::Error);
+    }
+
+    if (!gst_element_link_many(input, queue, audioconvert, webrtcdsp, opusenc, audio_caps_capsfilter, webrtcsink, nullptr))
     {
         Debug::Log("Audio sending elements could not be linked.", Level::Error);
     }
 
+    /* Mute in front of the encoder, the capture and the processing keep their state */
+    GstPad* encoder_sinkpad = gst_element_get_static_pad(opusenc, "sink");
+    gst_pad_add_probe(encoder_sinkpad, GST_PAD_PROBE_TYPE_BUFFER, mute_probe, this, nullptr);
+    gst_object_unref(encoder_sinkpad);
+
+    running_ = setup;
+    uplink_.Attach(opusenc, webrtcsink);
+    uplink_.Start(main_context_);
     CreateBusThread();
 }
 
-GstElement* GstMicPipeline::add_wasapi2src(GstElement* pipeline)
+void GstMicPipeline::DestroyPipeline()
+{
+    /* The appsrc thread may be waiting for Unity samples */
+    unity_source_.Stop();
+    Debug::Log(uplink_.Report() + ", " + std::to_string(muted_buffers_.load()) + " buffers muted");
+    GstBasePipeline::DestroyPipeline();
+    uplink_.Stop();
+    unity_source_.Release();
+    running_ = Setup();
+}
+
+void GstMicPipeline::SetMuted(bool muted)
+{
+    if (muted_.exchange(muted) != muted)
+        Debug::Log(muted ? "Microphone muted" : "Microphone unmuted", Level::Info);
+}
+
+GstPadProbeReturn GstMicPipeline::mute_probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata)
 {
-    GstElement* wasapi2src = gst_element_factory_make("wasapi2src", nullptr);
-    if (!wasapi2src)
+    auto self = static_cast<GstMicPipeline*>(udata);
+    if (!self->muted_.load(std::memory_order_relaxed))
+        return GST_PAD_PROBE_OK;
+
+    /* Zero is silence for the raw formats webrtcdsp outputs, DTX then sends next to nothing */
+    GstBuffer* buffer = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+    gst_buffer_memset(buffer, 0, 0, gst_buffer_get_size(buffer));
+    GST_PAD_PROBE_INFO_DATA(info) = buffer;
+    self->muted_buffers_.fetch_add(1, std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+void GstMicPipeline::SetSource(MicSource source, gint rate, gint channels, guint capacity_ms)
+{
+    source_ = source;
+    rate_ = rate;
+    channels_ = channels;
+    capacity_ms_ = capacity_ms;
+    unity_source_.SetFormat(rate, channels, capacity_ms);
+}
+
+GstMicPipeline::Setup GstMicPipeline::get_setup(const char* uri) const
+{
+    Setup setup;
+    setup.uri = uri;
+    setup.source = source_;
+    if (source_ == MicSource::Unity)
     {
-        Debug::Log("Failed to create wasapi2src", Level::Error);
+        setup.rate = rate_;
+        setup.channels = channels_;
+        setup.capacity_ms = capacity_ms_;
+    }
+    setup.dtx = uplink_.GetConfig().dtx;
+    return setup;
+}
+
+void GstMicPipeline::GetUplinkStats(gint64* values, int count)
+{
+    for (int i = 0; i < count && i < OpusUplinkController::StatCount; i++)
+        values[i] = uplink_.Get(static_cast<OpusUplinkController::Stat>(i));
+}
+
+void GstMicPipeline::GetUnitySourceStats(gint64* values, int count)
+{
+    for (int i = 0; i < count && i < MicRingSource::StatCount; i++)
+        values[i] = (gint64)unity_source_.Get(static_cast<MicRingSource::Stat>(i));
+    for (int i = MicRingSource::StatCount; i < count && i < MicRingSource::StatCount + PcmRingBuffer::StatCount; i++)
+        values[i] = unity_source_.GetRing(static_cast<PcmRingBuffer::Stat>(i - MicRingSource::StatCount));
+}
+
+GstElement* GstMicPipeline::add_audiosrc(GstElement* pipeline)
+{
+#ifdef _WIN32
+    GstElement* audiosrc = gst_element_factory_make("wasapi2src", nullptr);
+#else
+    GstElement* audiosrc = gst_element_factory_make("autoaudiosrc", nullptr);
+#endif
+    if (!audiosrc)
+    {
+        Debug::Log("Failed to create audio source", Level::Error);
         return nullptr;
     }
-    g_object_set(wasapi2src, "low-latency", true, "provide-clock", false, nullptr);
+#ifdef _WIN32
+    g_object_set(audiosrc, "low-latency", true, "provide-clock", false, nullptr);
+#endif
 
-    gst_bin_add(GST_BIN(pipeline), wasapi2src);
-    return wasapi2src;
+    gst_bin_add(GST_BIN(pipeline), audiosrc);
+    return audiosrc;
 }
 
 GstElement* GstMicPipeline::add_queue(GstElement* pipeline)
@@ -71,6 +178,19 @@ GstElement* GstMicPipeline::add_audioconvert(GstElement* pipeline)
     return audioconvert;
 }
 
+GstElement* GstMicPipeline::add_audioresample(GstElement* pipeline)
+{
+    GstElement* audioresample = gst_element_factory_make("audioresample", nullptr);
+    if (!audioresample)
+    {
+        Debug::Log("Failed to create audioresample", Level::Error);
+        return nullptr;
+    }
+
+    gst_bin_add(GST_BIN(pipeline), audioresample);
+    return audioresample;
+}
+
 GstElement* GstMicPipeline::add_opusenc(GstElement* pipeline)
 {
     GstElement* opusenc = gst_element_factory_make("opusenc", nullptr);
@@ -4,20 +4,82 @@
 
 #pragma once
 #include "GstBasePipeline.h"
+#include "MicRingSource.h"
+#include "OpusUplinkController.h"
+#include <atomic>
+#include <string>
+
+enum class MicSource
+{
+    Device, // wasapi2src on Windows, autoaudiosrc elsewhere
+    Unity   // samples pushed by PushMicAudio
+};
 
 class GstMicPipeline : public GstBasePipeline
 {
+private:
+    /* What a pipeline is built with, the running one is only kept when it matches */
+    struct Setup
+    {
+        std::string uri;
+        MicSource source = MicSource::Device;
+        gint rate = 0; // Unity source only
+        gint channels = 0;
+        guint capacity_ms = 0;
+        bool dtx = true;
+
+        bool operator==(const Setup& other) const
+        {
+            return uri == other.uri && source == other.source && rate == other.rate && channels == other.channels &&
+                   capacity_ms == other.capacity_ms && dtx == other.dtx;
+        }
+    };
+
+    /* Unity main thread, like CreatePipeline */
+    MicSource source_ = MicSource::Device;
+    gint rate_ = 48000;
+    gint channels_ = 1;
+    guint capacity_ms_ = 60;
+    Setup running_;
+
+    MicRingSource unity_source_;
+    OpusUplinkController uplink_;
+    std::atomic<bool> muted_{false};
+    std::atomic<guint64> muted_buffers_{0};
 
 public:
     GstMicPipeline();
 
+    // Keeps the running pipeline when it still streams to uri with the same source, format and DTX mode:
+    // capture, processing and encoding stay hot. Otherwise the pipeline is rebuilt.
     void CreatePipeline(const char* uri, const char* remote_peer_id);
+    void DestroyPipeline() override;
+    bool IsRunning() const { return pipeline_ != nullptr && streaming_; }
+
+    // Encodes silence while muted (DTX packets), without state change: unmuting takes effect on the next buffer
+    void SetMuted(bool muted);
+    bool IsMuted() const { return muted_.load(std::memory_order_relaxed); }
+
+    // Applied by the next CreatePipeline
+    void SetSource(MicSource source, gint rate, gint channels, guint capacity_ms);
+    // Unity audio thread, interleaved float samples. Returns how many were queued.
+    gsize PushAudio(const float* samples, gsize count) { return unity_source_.Push(samples, count); }
+    // Bitrate and frame size of the encoder are applied at once, DTX by the next CreatePipeline
+    void SetUplinkConfig(const OpusUplinkController::Config& config) { uplink_.Configure(config); }
+    OpusUplinkController::Config GetUplinkConfig() const { return uplink_.GetConfig(); }
+    // Values in OpusUplinkController::Stat order
+    void GetUplinkStats(gint64* values, int count);
+    // Values in MicRingSource::Stat order then PcmRingBuffer::Stat order
+    void GetUnitySourceStats(gint64* values, int count);
 
 private:  
+    Setup get_setup(const char* uri) const;
+    static GstPadProbeReturn mute_probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata);
     static void consumer_added_callback(GstElement* consumer_id, gchararray webrtcbin, GstElement* arg1, gpointer udata);
     static GstElement* add_queue(GstElement* pipeline);
     static GstElement* add_audioconvert(GstElement* pipeline);
-    static GstElement* add_wasapi2src(GstElement* pipeline);
+    static GstElement* add_audiosrc(GstElement* pipeline);
+    static GstElement* add_audioresample(GstElement* pipeline);
     static GstElement* add_opusenc(GstElement* pipeline);
     static GstElement* add_audio_caps_capsfilter(GstElement* pipeline);
     static GstElement* add_webrtcsink(GstElement* pipeline, const std::string& uri);
@@ -0,0 +1,182 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "JitterLatencyController.h"
+#include "DebugLog.h"
+#include <algorithm>
+
+JitterLatencyController::~JitterLatencyController() { Stop(); }
+
+void JitterLatencyController::Configure(const Config& config)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    config_ = config;
+    config_.max_ms = std::max(config_.max_ms, config_.min_ms);
+    config_.period_ms = std::max(config_.period_ms, 50u);
+}
+
+JitterLatencyController::Config JitterLatencyController::GetConfig() const
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    return config_;
+}
+
+void JitterLatencyController::Attach(GstElement* webrtcbin)
+{
+    GstElement* rtpbin = gst_bin_get_by_name(GST_BIN(webrtcbin), "rtpbin");
+    if (rtpbin == nullptr)
+    {
+        Debug::Log("Cannot find rtpbin in webrtcbin, jitterbuffer latency stays fixed", Level::Warning);
+        return;
+    }
+    g_signal_connect(rtpbin, "new-jitterbuffer", G_CALLBACK(on_new_jitterbuffer), this);
+    gst_object_unref(rtpbin);
+}
+
+void JitterLatencyController::Start(GMainContext* context)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    if (timeout_ != nullptr)
+        return;
+    timeout_ = g_timeout_source_new(config_.period_ms);
+    g_source_set_callback(timeout_, on_timeout, this, nullptr);
+    g_source_attach(timeout_, context);
+}
+
+void JitterLatencyController::Stop()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    if (timeout_ != nullptr)
+    {
+        g_source_destroy(timeout_);
+        g_source_unref(timeout_);
+        timeout_ = nullptr;
+    }
+    for (auto& stream : streams_)
+        gst_object_unref(stream.jitterbuffer);
+    streams_.clear();
+}
+
+void JitterLatencyController::on_new_jitterbuffer(GstElement* rtpbin, GstElement* jitterbuffer, guint session, guint ssrc,
+                                                  gpointer udata)
+{
+    auto self = static_cast<JitterLatencyController*>(udata);
+    std::lock_guard<std::mutex> lk(self->lock_);
+
+    /* Start from the lowest latency, the controller raises it if the link needs it */
+    Stream stream;
+    stream.jitterbuffer = GST_ELEMENT(gst_object_ref(jitterbuffer));
+    stream.ssrc = ssrc;
+    g_object_get(jitterbuffer, "latency", &stream.latency_ms, nullptr);
+    if (self->config_.enabled)
+    {
+        stream.latency_ms = self->config_.min_ms;
+        g_object_set(jitterbuffer, "latency", stream.latency_ms, nullptr);
+    }
+    self->streams_.push_back(stream);
+
+    Debug::Log("New jitterbuffer for ssrc " + std::to_string(ssrc) + ", latency " + std::to_string(stream.latency_ms) +
+               " ms");
+}
+
+gboolean JitterLatencyController::on_timeout(gpointer udata)
+{
+    static_cast<JitterLatencyController*>(udata)->update();
+    return G_SOURCE_CONTINUE;
+}
+
+void JitterLatencyController::update()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    for (auto& stream : streams_)
+    {
+        GstStructure* stats = nullptr;
+        g_object_get(stream.jitterbuffer, "stats", &stats, nullptr);
+        if (stats == nullptr)
+            continue;
+
+        guint64 pushed = 0, late = 0, lost = 0, jitter = 0;
+        gst_structure_get_uint64(stats, "num-pushed", &pushed);
+        gst_structure_get_uint64(stats, "num-late", &late);
+        gst_structure_get_uint64(stats, "num-lost", &lost);
+        gst_structure_get_uint64(stats, "avg-jitter", &jitter);
+        gst_structure_free(stats);
+
+        stream.late = late;
+        stream.lost = lost;
+        stream.jitter_us = jitter / 1000;
+
+        if (!config_.enabled)
+            continue;
+
+        const guint latency = next_latency(config_, stream, pushed, late, lost);
+        if (latency != stream.latency_ms)
+        {
+            Debug::Log("Jitterbuffer ssrc " + std::to_string(stream.ssrc) + " latency " +
+                       std::to_string(stream.latency_ms) + " -> " + std::to_string(latency) + " ms (jitter " +
+                       std::to_string(stream.jitter_us) + " us)");
+            stream.latency_ms = latency;
+            /* The jitterbuffer posts a latency message, the bus handler redistributes the pipeline latency */
+            g_object_set(stream.jitterbuffer, "latency", latency, nullptr);
+        }
+    }
+}
+
+guint JitterLatencyController::next_latency(const Config& config, Stream& stream, guint64 pushed, guint64 late,
+                                            guint64 lost)
+{
+    const guint64 new_pushed = pushed - std::min(pushed, stream.prev_pushed);
+    const guint64 new_late = late - std::min(late, stream.prev_late);
+    const guint64 new_lost = lost - std::min(lost, stream.prev_lost);
+    stream.prev_pushed = pushed;
+    stream.prev_late = late;
+    stream.prev_lost = lost;
+
+    const guint floor = static_cast<guint>(config.jitter_factor * stream.jitter_us / 1000);
+    const bool burst = new_lost > 0 && new_lost >= config.loss_threshold * (new_pushed + new_lost);
+
+    guint latency = stream.latency_ms;
+    if (new_late > 0 || burst)
+    {
+        /* Packets came after their deadline: catch up at once */
+        latency = std::max({latency + latency / 2, latency + 10, floor});
+        stream.calm = 0;
+    }
+    else if (++stream.calm >= config.calm_periods)
+    {
+        latency = std::max(latency - std::min(latency, config.step_down_ms), floor);
+        stream.calm = 0;
+    }
+    else
+    {
+        latency = std::max(latency, floor);
+    }
+
+    return std::clamp(latency, config.min_ms, config.max_ms);
+}
+
+std::vector<JitterLatencyController::StreamStats> JitterLatencyController::GetStats() const
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    std::vector<StreamStats> stats;
+    for (const auto& stream : streams_)
+        stats.push_back({stream.ssrc, stream.latency_ms, stream.late, stream.lost, stream.jitter_us});
+    return stats;
+}
+
+std::string JitterLatencyController::Report() const
+{
+    const std::vector<StreamStats> stats = GetStats();
+    if (stats.empty())
+        return "";
+
+    std::string report = "Jitterbuffers:";
+    for (const auto& stream : stats)
+    {
+        report += " [ssrc=" + std::to_string(stream.ssrc) + " latency=" + std::to_string(stream.latency_ms) +
+                  "ms jitter=" + std::to_string(stream.jitter_us) + "us late=" + std::to_string(stream.late) +
+                  " lost=" + std::to_string(stream.lost) + "]";
+    }
+    return report;
+}
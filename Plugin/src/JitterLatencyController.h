@@ -0,0 +1,83 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <gst/gst.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Adjusts the latency of each rtpjitterbuffer of webrtcbin from its statistics.
+ * Late packets (or a loss burst) raise the latency at once, a calm link lowers it slowly,
+ * never under jitter_factor times the measured jitter. Latency stays within [min_ms, max_ms].
+ * Jitterbuffers are added from the streaming threads, the controller runs in a timeout of the pipeline main context. */
+class JitterLatencyController
+{
+public:
+    struct Config
+    {
+        bool enabled = true;
+        guint min_ms = 1;
+        guint max_ms = 200;
+        float jitter_factor = 3.0f;   // latency floor, in units of average jitter
+        float loss_threshold = 0.02f; // lost / received over a period that counts as a burst
+        guint period_ms = 500;
+        guint calm_periods = 10; // periods without late packets before lowering the latency
+        guint step_down_ms = 5;
+    };
+
+    struct StreamStats
+    {
+        guint ssrc;
+        guint latency_ms;
+        guint64 late;
+        guint64 lost;
+        guint64 jitter_us;
+    };
+
+private:
+    struct Stream
+    {
+        GstElement* jitterbuffer; // owned ref
+        guint ssrc;
+        guint latency_ms;
+        guint64 prev_pushed = 0;
+        guint64 prev_late = 0;
+        guint64 prev_lost = 0;
+        guint64 late = 0;
+        guint64 lost = 0;
+        guint64 jitter_us = 0;
+        guint calm = 0;
+    };
+
+    mutable std::mutex lock_;
+    Config config_;
+    std::vector<Stream> streams_;
+    GSource* timeout_ = nullptr;
+
+public:
+    JitterLatencyController() = default;
+    ~JitterLatencyController();
+    JitterLatencyController(const JitterLatencyController&) = delete;
+    JitterLatencyController& operator=(const JitterLatencyController&) = delete;
+
+    void Configure(const Config& config);
+    Config GetConfig() const;
+
+    // Watches the jitterbuffers created by the rtpbin of webrtcbin
+    void Attach(GstElement* webrtcbin);
+    void Start(GMainContext* context);
+    // Stops the timeout and forgets the jitterbuffers
+    void Stop();
+
+    std::vector<StreamStats> GetStats() const;
+    std::string Report() const;
+
+private:
+    static void on_new_jitterbuffer(GstElement* rtpbin, GstElement* jitterbuffer, guint session, guint ssrc,
+                                    gpointer udata);
+    static gboolean on_timeout(gpointer udata);
+    void update();
+    static guint next_latency(const Config& config, Stream& stream, guint64 pushed, guint64 late, guint64 lost);
+};
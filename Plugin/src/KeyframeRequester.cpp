@@ -0,0 +1,135 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "KeyframeRequester.h"
+#include "DebugLog.h"
+#include <algorithm>
+#include <gst/video/video.h>
+
+KeyframeRequester::~KeyframeRequester() { Detach(); }
+
+void KeyframeRequester::Attach(GstElement* depayloader)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    detach();
+
+    bin_ = GST_ELEMENT(gst_object_get_parent(GST_OBJECT(depayloader)));
+    rtp_pad_ = gst_element_get_static_pad(depayloader, "sink");
+    rtp_probe_ = gst_pad_add_probe(rtp_pad_, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, rtp_probe, this, nullptr);
+    coded_pad_ = gst_element_get_static_pad(depayloader, "src");
+    coded_probe_ = gst_pad_add_probe(coded_pad_, GST_PAD_PROBE_TYPE_BUFFER, coded_probe, this, nullptr);
+
+    first_buffer_ = true;
+    interval_us_ = min_interval_us_;
+    last_request_us_ = 0;
+    broken_since_us_ = 0;
+}
+
+void KeyframeRequester::Detach()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    detach();
+}
+
+// Call with lock_ held
+void KeyframeRequester::detach()
+{
+    if (rtp_pad_ != nullptr)
+    {
+        gst_pad_remove_probe(rtp_pad_, rtp_probe_);
+        gst_clear_object(&rtp_pad_);
+    }
+    if (coded_pad_ != nullptr)
+    {
+        gst_pad_remove_probe(coded_pad_, coded_probe_);
+        gst_clear_object(&coded_pad_);
+    }
+    gst_clear_object(&bin_);
+}
+
+bool KeyframeRequester::Owns(GstObject* object)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    return bin_ != nullptr && (object == GST_OBJECT(bin_) || gst_object_has_as_ancestor(object, GST_OBJECT(bin_)));
+}
+
+void KeyframeRequester::Configure(gint64 min_interval_us, gint64 max_interval_us)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    min_interval_us_ = std::max<gint64>(min_interval_us, 0);
+    max_interval_us_ = std::max(max_interval_us, min_interval_us_);
+    interval_us_ = min_interval_us_;
+}
+
+void KeyframeRequester::Request(Reason reason)
+{
+    static const Counter COUNTERS[] = {PacketLossCount, DecodeErrorCount, QosCount, ResumeCount};
+    counters_[COUNTERS[static_cast<int>(reason)]].fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lk(lock_);
+    if (rtp_pad_ == nullptr)
+        return;
+
+    const gint64 now = g_get_monotonic_time();
+    if (broken_since_us_ == 0)
+        broken_since_us_ = now;
+
+    if (reason != Reason::Resume && last_request_us_ != 0)
+    {
+        if (now - last_request_us_ < interval_us_)
+        {
+            counters_[Suppressed].fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        /* The previous request is still unanswered, back off */
+        interval_us_ = std::min(interval_us_ * 2, max_interval_us_);
+    }
+
+    last_request_us_ = now;
+    counters_[Requests].fetch_add(1, std::memory_order_relaxed);
+    /* Turned into a PLI by the RTP session */
+    gst_pad_push_event(rtp_pad_, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+}
+
+void KeyframeRequester::on_keyframe()
+{
+    counters_[Keyframes].fetch_add(1, std::memory_order_relaxed);
+
+    std::lock_guard<std::mutex> lk(lock_);
+    if (broken_since_us_ != 0)
+    {
+        const gint64 elapsed = g_get_monotonic_time() - broken_since_us_;
+        counters_[Recoveries].fetch_add(1, std::memory_order_relaxed);
+        counters_[LastRecoveryUs].store(elapsed, std::memory_order_relaxed);
+        Debug::Log("Picture recovered in " + std::to_string(elapsed) + "us");
+    }
+    broken_since_us_ = 0;
+    last_request_us_ = 0;
+    interval_us_ = min_interval_us_;
+}
+
+GstPadProbeReturn KeyframeRequester::rtp_probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata)
+{
+    /* Sent by the jitterbuffer when it gives up on a packet */
+    GstEvent* event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_CUSTOM_DOWNSTREAM && gst_event_has_name(event, "GstRTPPacketLost"))
+        static_cast<KeyframeRequester*>(udata)->Request(Reason::PacketLoss);
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn KeyframeRequester::coded_probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata)
+{
+    auto self = static_cast<KeyframeRequester*>(udata);
+    GstBuffer* buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+        self->on_keyframe();
+    else if (GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DISCONT) && !self->first_buffer_)
+    {
+        /* The depayloader saw a sequence number gap */
+        self->Request(Reason::PacketLoss);
+    }
+    self->first_buffer_ = false;
+    return GST_PAD_PROBE_OK;
+}
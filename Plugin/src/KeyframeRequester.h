@@ -0,0 +1,79 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <atomic>
+#include <gst/gst.h>
+#include <mutex>
+
+/* Asks the sender for a keyframe when the picture is broken, instead of waiting for the next periodic IDR.
+ * Loss is seen at the depayloader (discontinuities, GstRTPPacketLost events), decode errors and QoS come from the bus,
+ * QoS only in synced A/V mode.
+ * Requests are GstForceKeyUnit upstream events, turned into PLI by the RTP session. They are rate limited: the
+ * interval between two requests doubles while no keyframe arrives, and falls back to the minimum once one does.
+ * Thread safe. */
+class KeyframeRequester
+{
+public:
+    enum class Reason
+    {
+        PacketLoss,
+        DecodeError,
+        Qos,
+        Resume // the stream was paused, sent without rate limit
+    };
+
+    // Order of the values returned by GetKeyframeStats, do not reorder
+    enum Counter
+    {
+        Requests,        // events sent upstream
+        Suppressed,      // requests skipped by the rate limit
+        PacketLossCount, // detections per reason
+        DecodeErrorCount,
+        QosCount,
+        ResumeCount,
+        Keyframes,      // keyframes seen at the depayloader output
+        Recoveries,     // keyframes that ended a broken picture
+        LastRecoveryUs, // from the first detection to the keyframe, for the last recovery
+        CounterCount
+    };
+
+private:
+    std::mutex lock_;
+    GstElement* bin_ = nullptr;
+    GstPad* rtp_pad_ = nullptr; // depayloader sink pad
+    gulong rtp_probe_ = 0;
+    GstPad* coded_pad_ = nullptr; // depayloader src pad
+    gulong coded_probe_ = 0;
+    bool first_buffer_ = true;
+
+    gint64 min_interval_us_ = 100000;
+    gint64 max_interval_us_ = 2000000;
+    gint64 interval_us_ = 100000;
+    gint64 last_request_us_ = 0;
+    gint64 broken_since_us_ = 0; // 0 when the picture is clean
+
+    std::atomic<guint64> counters_[CounterCount] = {};
+
+public:
+    KeyframeRequester() = default;
+    ~KeyframeRequester();
+    KeyframeRequester(const KeyframeRequester&) = delete;
+    KeyframeRequester& operator=(const KeyframeRequester&) = delete;
+
+    void Attach(GstElement* depayloader);
+    void Detach();
+    // True if object belongs to the attached decode branch
+    bool Owns(GstObject* object);
+
+    void Configure(gint64 min_interval_us, gint64 max_interval_us);
+    void Request(Reason reason);
+    guint64 Get(Counter counter) const { return counters_[counter].load(std::memory_order_relaxed); }
+
+private:
+    void detach();
+    void on_keyframe();
+    static GstPadProbeReturn rtp_probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata);
+    static GstPadProbeReturn coded_probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata);
+};
@@ -0,0 +1,66 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "LatencyHistogram.h"
+#include <algorithm>
+
+constexpr gint64 LatencyHistogram::BUCKET_LIMITS_US[];
+
+void LatencyHistogram::Add(gint64 latency_us)
+{
+    if (latency_us < 0)
+        negative_.fetch_add(1, std::memory_order_relaxed);
+
+    const gint64* limit = std::upper_bound(BUCKET_LIMITS_US, BUCKET_LIMITS_US + BUCKET_COUNT - 1, latency_us);
+    buckets_[limit - BUCKET_LIMITS_US].fetch_add(1, std::memory_order_relaxed);
+
+    /* Single writer, plain stores are enough */
+    min_.store(std::min(min_.load(std::memory_order_relaxed), latency_us), std::memory_order_relaxed);
+    max_.store(std::max(max_.load(std::memory_order_relaxed), latency_us), std::memory_order_relaxed);
+    sum_.fetch_add(latency_us, std::memory_order_relaxed);
+    last_.store(latency_us, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::Clear()
+{
+    for (auto& bucket : buckets_)
+        bucket.store(0, std::memory_order_relaxed);
+    count_ = 0;
+    negative_ = 0;
+    min_ = G_MAXINT64;
+    max_ = G_MININT64;
+    sum_ = 0;
+    last_ = -1;
+}
+
+int LatencyHistogram::GetBuckets(guint64* buckets, int count) const
+{
+    count = std::min(count, BUCKET_COUNT);
+    for (int i = 0; i < count; i++)
+        buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+    return count;
+}
+
+gint64 LatencyHistogram::Get(Stat stat) const
+{
+    const guint64 count = count_.load(std::memory_order_relaxed);
+    switch (stat)
+    {
+        case Count:
+            return (gint64)count;
+        case Negative:
+            return (gint64)negative_.load(std::memory_order_relaxed);
+        case Min:
+            return count ? min_.load(std::memory_order_relaxed) : 0;
+        case Max:
+            return count ? max_.load(std::memory_order_relaxed) : 0;
+        case Mean:
+            return count ? sum_.load(std::memory_order_relaxed) / (gint64)count : 0;
+        case Last:
+            return count ? last_.load(std::memory_order_relaxed) : 0;
+        default:
+            return 0;
+    }
+}
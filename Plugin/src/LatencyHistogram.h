@@ -0,0 +1,48 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <atomic>
+#include <gst/gst.h>
+
+/* Fixed buckets of latency values, in microseconds.
+ * Add is called by a single thread, reads are lock free from any thread. */
+class LatencyHistogram
+{
+public:
+    static constexpr int BUCKET_COUNT = 16;
+    // Upper bound (excluded) of each bucket but the last one, which is unbounded
+    static constexpr gint64 BUCKET_LIMITS_US[BUCKET_COUNT - 1] = {
+        5000,  10000,  15000,  20000,  30000,  40000,  50000, 65000,
+        80000, 100000, 130000, 160000, 200000, 300000, 500000};
+
+    enum Stat
+    {
+        Count,
+        Negative, // values below 0, clocks of sender and receiver not in sync. Counted in the first bucket.
+        Min,
+        Max,
+        Mean,
+        Last,
+        StatCount
+    };
+
+private:
+    std::atomic<guint64> buckets_[BUCKET_COUNT] = {};
+    std::atomic<guint64> count_{0};
+    std::atomic<guint64> negative_{0};
+    std::atomic<gint64> min_{G_MAXINT64};
+    std::atomic<gint64> max_{G_MININT64};
+    std::atomic<gint64> sum_{0};
+    std::atomic<gint64> last_{-1};
+
+public:
+    void Add(gint64 latency_us);
+    void Clear();
+
+    // Fills up to count bucket counters, returns how many were written
+    int GetBuckets(guint64* buckets, int count) const;
+    // Microseconds, 0 while empty
+    gint64 Get(Stat stat) const;
+};
@@ -0,0 +1,153 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "MicRingSource.h"
+#include "DebugLog.h"
+#include <algorithm>
+
+MicRingSource::~MicRingSource()
+{
+    Stop();
+    Release();
+}
+
+void MicRingSource::SetFormat(gint rate, gint channels, guint capacity_ms)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    format_rate_ = rate;
+    format_channels_ = channels;
+    format_capacity_ms_ = capacity_ms;
+}
+
+GstElement* MicRingSource::CreateSource(GstElement* pipeline)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    GstElement* appsrc = gst_element_factory_make("appsrc", nullptr);
+    if (!appsrc)
+    {
+        Debug::Log("Failed to create appsrc", Level::Error);
+        return nullptr;
+    }
+
+    rate_ = format_rate_;
+    channels_ = format_channels_;
+    block_samples_ = (gsize)rate_ * channels_ * BLOCK_MS / 1000;
+    ring_.SetCapacity(std::max((gsize)rate_ * channels_ * format_capacity_ms_ / 1000, 2 * block_samples_));
+
+    GstCaps* caps = gst_caps_new_simple("audio/x-raw", "format", G_TYPE_STRING, "F32LE", "layout", G_TYPE_STRING,
+                                        "interleaved", "rate", G_TYPE_INT, rate_, "channels", G_TYPE_INT, channels_,
+                                        nullptr);
+    const guint block_bytes = (guint)(block_samples_ * sizeof(float));
+
+    /* A block in flight downstream, one being filled: the pool only allocates at startup */
+    pool_ = gst_buffer_pool_new();
+    GstStructure* config = gst_buffer_pool_get_config(pool_);
+    gst_buffer_pool_config_set_params(config, caps, block_bytes, 4, 0);
+    gst_buffer_pool_set_config(pool_, config);
+    gst_buffer_pool_set_active(pool_, TRUE);
+
+    /* Latency: a block is waited for, the ring may hold up to its capacity */
+    const gint64 block_latency = (gint64)BLOCK_MS * GST_MSECOND;
+    const gint64 ring_latency =
+        (gint64)gst_util_uint64_scale(ring_.Get(PcmRingBuffer::CapacitySamples), GST_SECOND, (guint64)rate_ * channels_);
+    g_object_set(appsrc, "caps", caps, "is-live", TRUE, "format", GST_FORMAT_TIME, "do-timestamp", FALSE, "min-latency",
+                 block_latency, "max-latency", std::max(ring_latency, block_latency), "max-bytes", (guint64)block_bytes * 2,
+                 nullptr);
+    gst_caps_unref(caps);
+
+    GstAppSrcCallbacks callbacks = {nullptr};
+    callbacks.need_data = need_data;
+    gst_app_src_set_callbacks(GST_APP_SRC(appsrc), &callbacks, this, nullptr);
+
+    next_pts_ = GST_CLOCK_TIME_NONE;
+    offset_ = 0;
+    stopping_ = false;
+    ring_.Clear();
+
+    gst_bin_add(GST_BIN(pipeline), appsrc);
+    return appsrc;
+}
+
+void MicRingSource::Stop() { stopping_ = true; }
+
+void MicRingSource::Release()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    if (pool_ != nullptr)
+    {
+        gst_buffer_pool_set_active(pool_, FALSE);
+        gst_clear_object(&pool_);
+    }
+    ring_.Clear();
+}
+
+gsize MicRingSource::Push(const float* samples, gsize count)
+{
+    const gsize written = ring_.Write(samples, count);
+    if (written < count)
+        ring_.Drop(count - written);
+    return written;
+}
+
+void MicRingSource::need_data(GstAppSrc* appsrc, guint length, gpointer udata)
+{
+    auto self = static_cast<MicRingSource*>(udata);
+    GstBuffer* block = self->take_block(appsrc);
+    if (block != nullptr)
+        gst_app_src_push_buffer(appsrc, block);
+}
+
+GstBuffer* MicRingSource::take_block(GstAppSrc* appsrc)
+{
+    const gsize samples = block_samples_;
+    const guint64 frame_rate = (guint64)rate_;
+    const GstClockTime duration = gst_util_uint64_scale(samples / channels_, GST_SECOND, frame_rate);
+
+    /* Wait for a full block, at most two block durations so that a stalled producer turns into silence */
+    const gint64 deadline = g_get_monotonic_time() + 2 * BLOCK_MS * 1000;
+    while ((gsize)ring_.Get(PcmRingBuffer::FillSamples) < samples && !stopping_ && g_get_monotonic_time() < deadline)
+        g_usleep(1000);
+    if (stopping_)
+        return nullptr;
+
+    GstBuffer* buffer = nullptr;
+    if (gst_buffer_pool_acquire_buffer(pool_, &buffer, nullptr) != GST_FLOW_OK)
+        return nullptr;
+
+    /* The block was pushed about the ring fill before now */
+    const gsize fill = (gsize)ring_.Get(PcmRingBuffer::FillSamples);
+    GstMapInfo map;
+    gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+    const gsize read = ring_.Read(reinterpret_cast<float*>(map.data), samples);
+    gst_buffer_unmap(buffer, &map);
+
+    stats_[Blocks].fetch_add(1, std::memory_order_relaxed);
+    if (read < samples)
+        stats_[SilentBlocks].fetch_add(1, std::memory_order_relaxed);
+
+    const GstClockTime now = gst_element_get_current_running_time(GST_ELEMENT(appsrc));
+    const GstClockTime queued = gst_util_uint64_scale(fill / channels_, GST_SECOND, frame_rate);
+    GstClockTime pts = GST_CLOCK_TIME_IS_VALID(now) && now > queued ? now - queued : 0;
+
+    /* Contiguous timestamps unless they drifted away from the pipeline clock */
+    if (GST_CLOCK_TIME_IS_VALID(next_pts_) && GST_CLOCK_DIFF(next_pts_, pts) < (GstClockTimeDiff)RESYNC_THRESHOLD &&
+        GST_CLOCK_DIFF(pts, next_pts_) < (GstClockTimeDiff)RESYNC_THRESHOLD)
+    {
+        pts = next_pts_;
+    }
+    else
+    {
+        if (GST_CLOCK_TIME_IS_VALID(next_pts_))
+            stats_[Resyncs].fetch_add(1, std::memory_order_relaxed);
+        GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+    }
+
+    GST_BUFFER_PTS(buffer) = pts;
+    GST_BUFFER_DURATION(buffer) = duration;
+    GST_BUFFER_OFFSET(buffer) = offset_;
+    offset_ += samples / channels_;
+    GST_BUFFER_OFFSET_END(buffer) = offset_;
+    next_pts_ = pts + duration;
+    return buffer;
+}
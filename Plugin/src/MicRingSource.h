@@ -0,0 +1,75 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include "PcmRingBuffer.h"
+#include <atomic>
+#include <gst/app/app.h>
+#include <gst/gst.h>
+#include <mutex>
+
+/* Microphone audio pushed by Unity (headset mic, test signal), fed to the mic pipeline by a live appsrc.
+ * Push only copies into the ring: no lock, no allocation on the Unity audio thread.
+ * The appsrc streaming thread takes 10 ms blocks from the ring into pooled buffers, timestamped with the running time
+ * they were pushed at and kept contiguous while the Unity clock and the pipeline clock agree. Silence fills the
+ * blocks Unity did not push in time. */
+class MicRingSource
+{
+public:
+    enum Stat
+    {
+        Blocks,       // pushed downstream
+        SilentBlocks, // partly or fully silence
+        Resyncs,      // timestamps realigned on the pipeline clock
+        StatCount
+    };
+
+private:
+    static constexpr guint BLOCK_MS = 10;
+    static constexpr GstClockTime RESYNC_THRESHOLD = 20 * GST_MSECOND;
+
+    std::mutex lock_;
+    GstBufferPool* pool_ = nullptr;
+    PcmRingBuffer ring_;
+    gint format_rate_ = 48000;
+    gint format_channels_ = 1;
+    guint format_capacity_ms_ = 60;
+
+    /* Set by CreateSource */
+    gint rate_ = 48000;
+    gint channels_ = 1;
+    gsize block_samples_ = 480;
+
+    /* appsrc streaming thread only */
+    GstClockTime next_pts_ = GST_CLOCK_TIME_NONE;
+    guint64 offset_ = 0;
+
+    std::atomic<bool> stopping_{false};
+    std::atomic<guint64> stats_[StatCount] = {};
+
+public:
+    MicRingSource() = default;
+    ~MicRingSource();
+    MicRingSource(const MicRingSource&) = delete;
+    MicRingSource& operator=(const MicRingSource&) = delete;
+
+    // Format of the pushed samples, applied by the next CreateSource
+    void SetFormat(gint rate, gint channels, guint capacity_ms);
+    // Returns the appsrc added to pipeline, nullptr on failure
+    GstElement* CreateSource(GstElement* pipeline);
+    // Before the pipeline stops: the streaming thread no longer waits for samples
+    void Stop();
+    // Once the pipeline is stopped
+    void Release();
+
+    // Unity audio thread, interleaved float samples. Returns how many fit in the ring.
+    gsize Push(const float* samples, gsize count);
+
+    guint64 Get(Stat stat) const { return stats_[stat].load(std::memory_order_relaxed); }
+    gint64 GetRing(PcmRingBuffer::Stat stat) const { return ring_.Get(stat); }
+
+private:
+    static void need_data(GstAppSrc* appsrc, guint length, gpointer udata);
+    GstBuffer* take_block(GstAppSrc* appsrc);
+};
@@ -0,0 +1,152 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "OpusLossTracker.h"
+
+OpusLossTracker::~OpusLossTracker() { Detach(); }
+
+void OpusLossTracker::Attach(GstElement* decoder)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    detach();
+
+    pad_ = gst_element_get_static_pad(decoder, "sink");
+    probe_ = gst_pad_add_probe(pad_, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+                               probe, this, nullptr);
+}
+
+void OpusLossTracker::Detach()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    detach();
+}
+
+// Call with lock_ held
+void OpusLossTracker::detach()
+{
+    if (pad_ != nullptr)
+    {
+        gst_pad_remove_probe(pad_, probe_);
+        gst_clear_object(&pad_);
+    }
+    pending_ = 0;
+}
+
+void OpusLossTracker::Reset()
+{
+    for (auto& counter : counters_)
+        counter = 0;
+}
+
+GstPadProbeReturn OpusLossTracker::probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata)
+{
+    auto self = static_cast<OpusLossTracker*>(udata);
+
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER)
+    {
+        self->on_packet(GST_PAD_PROBE_INFO_BUFFER(info));
+        return GST_PAD_PROBE_OK;
+    }
+
+    GstEvent* event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_GAP)
+        self->on_gap(event);
+    else if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP)
+        self->pending_ = 0;
+    return GST_PAD_PROBE_OK;
+}
+
+void OpusLossTracker::on_gap(GstEvent* event)
+{
+    GstClockTime timestamp, duration;
+    gst_event_parse_gap(event, &timestamp, &duration);
+
+    /* One GAP event may cover several packets lost in a row */
+    guint64 lost = 1;
+    if (GST_CLOCK_TIME_IS_VALID(duration) && packet_duration_ > 0)
+        lost = MAX((duration + packet_duration_ / 2) / packet_duration_, 1);
+
+    pending_ += lost;
+    counters_[Lost].fetch_add(lost, std::memory_order_relaxed);
+}
+
+void OpusLossTracker::on_packet(GstBuffer* buffer)
+{
+    counters_[Received].fetch_add(1, std::memory_order_relaxed);
+    if (GST_BUFFER_DURATION_IS_VALID(buffer) && GST_BUFFER_DURATION(buffer) > 0)
+        packet_duration_ = GST_BUFFER_DURATION(buffer);
+
+    if (pending_ == 0)
+        return;
+
+    bool fec = false;
+    GstMapInfo map;
+    if (gst_buffer_map(buffer, &map, GST_MAP_READ))
+    {
+        fec = HasLbrr(map.data, map.size);
+        gst_buffer_unmap(buffer, &map);
+    }
+
+    /* The FEC data only describes the packet right before */
+    if (fec)
+        counters_[Recovered].fetch_add(1, std::memory_order_relaxed);
+    counters_[Concealed].fetch_add(fec ? pending_ - 1 : pending_, std::memory_order_relaxed);
+    pending_ = 0;
+}
+
+bool OpusLossTracker::HasLbrr(const guint8* data, gsize size)
+{
+    if (size < 2)
+        return false;
+
+    /* TOC byte: configurations 0-11 are SILK, 12-15 hybrid, CELT only has no LBRR */
+    const guint8 toc = data[0];
+    const guint config = toc >> 3;
+    if (config >= 16)
+        return false;
+    const bool stereo = (toc & 0x4) != 0;
+    static const guint SILK_FRAME_MS[] = {10, 20, 40, 60};
+    const guint frame_ms = config < 12 ? SILK_FRAME_MS[config & 0x3] : SILK_FRAME_MS[config & 0x1];
+    const guint silk_frames = frame_ms > 20 ? frame_ms / 20 : 1;
+
+    /* Offset of the first Opus frame of the packet */
+    gsize offset = 1;
+    switch (toc & 0x3)
+    {
+        case 0:
+        case 1:
+            break;
+        case 2:
+            offset += data[1] < 252 ? 1 : 2;
+            break;
+        case 3:
+        {
+            const guint8 count = data[1];
+            offset = 2;
+            if (count & 0x40)
+            {
+                /* Padding length, 255 means 254 and another byte */
+                while (offset < size && data[offset] == 255)
+                    offset++;
+                offset++;
+            }
+            if (count & 0x80)
+            {
+                /* Lengths of all frames but the last */
+                for (guint frame = 1; frame < (count & 0x3f) && offset < size; frame++)
+                    offset += data[offset] < 252 ? 1 : 2;
+            }
+            break;
+        }
+    }
+    if (offset >= size)
+        return false;
+
+    /* SILK header: a VAD flag per 20 ms frame then the LBRR flag, for the mid channel then the side channel */
+    const guint8 header = data[offset];
+    bool lbrr = (header >> (7 - silk_frames)) & 0x1;
+    if (stereo)
+        lbrr = lbrr || ((header >> (6 - 2 * silk_frames)) & 0x1);
+    return lbrr;
+}
@@ -0,0 +1,60 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <atomic>
+#include <gst/gst.h>
+#include <mutex>
+
+/* Counts the lost Opus packets of the audio branch and how the decoder fills them.
+ * The jitterbuffer turns a lost packet into a GAP event at the decoder input. With in-band FEC the decoder rebuilds the
+ * last lost packet from the LBRR data of the next one when it carries some, the other lost packets are concealed (PLC).
+ * Attach and Detach follow the audio branch activation. */
+class OpusLossTracker
+{
+public:
+    // Order of the values returned by GetAudioLossStats, do not reorder
+    enum Counter
+    {
+        Received,  // packets at the decoder input
+        Lost,      // packets covered by GAP events
+        Concealed, // lost packets filled by PLC
+        Recovered, // lost packets decoded from the FEC data of the next packet
+        CounterCount
+    };
+
+private:
+    static constexpr GstClockTime DEFAULT_PACKET_DURATION = 20 * GST_MSECOND;
+
+    std::mutex lock_;
+    GstPad* pad_ = nullptr; // decoder sink pad
+    gulong probe_ = 0;
+
+    /* Streaming thread only */
+    GstClockTime packet_duration_ = DEFAULT_PACKET_DURATION;
+    guint64 pending_ = 0; // lost packets waiting for the next one
+
+    std::atomic<guint64> counters_[CounterCount] = {};
+
+public:
+    OpusLossTracker() = default;
+    ~OpusLossTracker();
+    OpusLossTracker(const OpusLossTracker&) = delete;
+    OpusLossTracker& operator=(const OpusLossTracker&) = delete;
+
+    void Attach(GstElement* decoder);
+    void Detach();
+
+    guint64 Get(Counter counter) const { return counters_[counter].load(std::memory_order_relaxed); }
+    void Reset();
+
+    // True if the Opus packet carries LBRR (in-band FEC) data for the previous one, see RFC 6716 4.2.3
+    static bool HasLbrr(const guint8* data, gsize size);
+
+private:
+    static GstPadProbeReturn probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata);
+    void on_gap(GstEvent* event);
+    void on_packet(GstBuffer* buffer);
+    void detach();
+};
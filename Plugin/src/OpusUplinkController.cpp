@@ -0,0 +1,230 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "OpusUplinkController.h"
+#include "DebugLog.h"
+#include <algorithm>
+#include <gst/webrtc/webrtc.h>
+
+OpusUplinkController::~OpusUplinkController() { Stop(); }
+
+void OpusUplinkController::Configure(const Config& config)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    config_ = config;
+    config_.max_bitrate = std::clamp(config_.max_bitrate, 6000, 510000);
+    config_.min_bitrate = std::clamp(config_.min_bitrate, 6000, config_.max_bitrate);
+    config_.frame_size_ms = config_.frame_size_ms >= 20 ? 20 : 10;
+    config_.period_ms = std::max(config_.period_ms, 100u);
+    bitrate_ = std::clamp(bitrate_, config_.min_bitrate, config_.max_bitrate);
+    frame_size_ms_ = config_.frame_size_ms;
+    apply_encoder();
+}
+
+OpusUplinkController::Config OpusUplinkController::GetConfig() const
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    return config_;
+}
+
+void OpusUplinkController::Attach(GstElement* encoder, GstElement* webrtcsink)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    detach();
+
+    encoder_ = GST_ELEMENT(gst_object_ref(encoder));
+    webrtcsink_ = GST_ELEMENT(gst_object_ref(webrtcsink));
+    pad_ = gst_element_get_static_pad(encoder_, "src");
+    probe_ = gst_pad_add_probe(pad_, GST_PAD_PROBE_TYPE_BUFFER, probe, this, nullptr);
+
+    bitrate_ = config_.max_bitrate;
+    frame_size_ms_ = config_.frame_size_ms;
+    dtx_ = config_.dtx;
+    clean_ = 0;
+    bytes_ = 0;
+    packets_ = 0;
+    dtx_packets_ = 0;
+    prev_bytes_ = prev_packets_ = prev_dtx_ = 0;
+    prev_time_us_ = g_get_monotonic_time();
+    for (auto& stat : stats_)
+        stat = 0;
+    stats_[RoundTripUs] = -1;
+
+    /* opusenc only reads the application when it creates its encoder, the DTX mode is set once here */
+    gst_util_set_object_arg(G_OBJECT(encoder_), "audio-type", dtx_ ? "voice" : "restricted-lowdelay");
+    gst_util_set_object_arg(G_OBJECT(encoder_), "bitrate-type", dtx_ ? "constrained-vbr" : "cbr");
+    g_object_set(encoder_, "dtx", dtx_, nullptr);
+    apply_encoder();
+}
+
+void OpusUplinkController::Start(GMainContext* context)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    if (timeout_ != nullptr)
+        return;
+    timeout_ = g_timeout_source_new(config_.period_ms);
+    g_source_set_callback(timeout_, on_timeout, this, nullptr);
+    g_source_attach(timeout_, context);
+}
+
+void OpusUplinkController::Stop()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    if (timeout_ != nullptr)
+    {
+        g_source_destroy(timeout_);
+        g_source_unref(timeout_);
+        timeout_ = nullptr;
+    }
+    detach();
+}
+
+// Call with lock_ held
+void OpusUplinkController::detach()
+{
+    if (pad_ != nullptr)
+    {
+        gst_pad_remove_probe(pad_, probe_);
+        gst_clear_object(&pad_);
+    }
+    gst_clear_object(&encoder_);
+    gst_clear_object(&webrtcsink_);
+}
+
+// Call with lock_ held
+void OpusUplinkController::apply_encoder()
+{
+    if (encoder_ == nullptr)
+        return;
+
+    g_object_set(encoder_, "inband-fec", TRUE, "bitrate", bitrate_, "frame-size", frame_size_ms_, nullptr);
+
+    stats_[TargetBitrate] = bitrate_;
+    stats_[FrameSizeMs] = frame_size_ms_;
+}
+
+GstPadProbeReturn OpusUplinkController::probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata)
+{
+    auto self = static_cast<OpusUplinkController*>(udata);
+    GstBuffer* buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    /* Opus DTX frames are 1 or 2 bytes, opusenc may also flag them as gaps */
+    const gsize size = gst_buffer_get_size(buffer);
+    self->bytes_.fetch_add(size, std::memory_order_relaxed);
+    self->packets_.fetch_add(1, std::memory_order_relaxed);
+    if (size <= 2 || GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_GAP))
+        self->dtx_packets_.fetch_add(1, std::memory_order_relaxed);
+    return GST_PAD_PROBE_OK;
+}
+
+gboolean OpusUplinkController::on_timeout(gpointer udata)
+{
+    static_cast<OpusUplinkController*>(udata)->update();
+    return G_SOURCE_CONTINUE;
+}
+
+bool OpusUplinkController::find_remote_inbound(const GstStructure* stats, double* rtt_s, double* fraction_lost,
+                                               int depth)
+{
+    GstWebRTCStatsType type;
+    if (gst_structure_get_enum(stats, "type", GST_TYPE_WEBRTC_STATS_TYPE, (gint*)&type) &&
+        type == GST_WEBRTC_STATS_REMOTE_INBOUND_RTP)
+    {
+        gst_structure_get_double(stats, "round-trip-time", rtt_s);
+        gst_structure_get_double(stats, "fraction-lost", fraction_lost);
+        return true;
+    }
+    if (depth == 0)
+        return false;
+
+    /* webrtcsink statistics hold the webrtcbin ones of each consumer */
+    for (gint i = 0; i < gst_structure_n_fields(stats); i++)
+    {
+        const GValue* value = gst_structure_get_value(stats, gst_structure_nth_field_name(stats, i));
+        if (GST_VALUE_HOLDS_STRUCTURE(value) &&
+            find_remote_inbound(gst_value_get_structure(value), rtt_s, fraction_lost, depth - 1))
+            return true;
+    }
+    return false;
+}
+
+void OpusUplinkController::update()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    if (encoder_ == nullptr)
+        return;
+
+    /* Encoder output over the period */
+    const gint64 now = g_get_monotonic_time();
+    const guint64 bytes = bytes_.load(std::memory_order_relaxed);
+    const guint64 packets = packets_.load(std::memory_order_relaxed);
+    const guint64 dtx = dtx_packets_.load(std::memory_order_relaxed);
+    const gint64 elapsed = std::max<gint64>(now - prev_time_us_, 1);
+    const guint64 period_packets = packets - prev_packets_;
+    stats_[OutputBitrate] = (gint64)((bytes - prev_bytes_) * 8 * G_USEC_PER_SEC / elapsed);
+    stats_[Packets] = (gint64)packets;
+    stats_[DtxPackets] = (gint64)dtx;
+    stats_[DtxPermille] = period_packets > 0 ? (gint64)((dtx - prev_dtx_) * 1000 / period_packets) : 0;
+    prev_bytes_ = bytes;
+    prev_packets_ = packets;
+    prev_dtx_ = dtx;
+    prev_time_us_ = now;
+
+    double rtt_s = -1.0, fraction_lost = 0.0;
+    GstStructure* stats = nullptr;
+    g_object_get(webrtcsink_, "stats", &stats, nullptr);
+    const bool reported = stats != nullptr && find_remote_inbound(stats, &rtt_s, &fraction_lost, 3);
+    if (stats != nullptr)
+        gst_structure_free(stats);
+    if (!reported)
+        return;
+
+    stats_[RoundTripUs] = rtt_s >= 0.0 ? (gint64)(rtt_s * G_USEC_PER_SEC) : -1;
+    stats_[LossPermille] = (gint64)(fraction_lost * 1000);
+    if (!config_.adaptive)
+        return;
+
+    const gint bitrate = bitrate_;
+    const gint frame_size_ms = frame_size_ms_;
+    const bool congested = fraction_lost > config_.loss_threshold || rtt_s * 1000 > config_.rtt_threshold_ms;
+    if (congested)
+    {
+        bitrate_ = std::max((gint)(bitrate_ * BACKOFF), config_.min_bitrate);
+        frame_size_ms_ = 20;
+        clean_ = 0;
+    }
+    else if (++clean_ >= CLEAN_PERIODS)
+    {
+        bitrate_ = std::min(bitrate_ + STEP_UP, config_.max_bitrate);
+        frame_size_ms_ = config_.frame_size_ms;
+    }
+
+    /* Redundancy for the loss the receiver sees, a little more than measured */
+    g_object_set(encoder_, "packet-loss-percentage", std::clamp((gint)(fraction_lost * 100) + 2, 0, 100), nullptr);
+    if (bitrate_ != bitrate || frame_size_ms_ != frame_size_ms)
+    {
+        Debug::Log("Mic uplink " + std::to_string(bitrate) + " -> " + std::to_string(bitrate_) + " bps, " +
+                   std::to_string(frame_size_ms_) + " ms frames (loss " + std::to_string(fraction_lost) + ", rtt " +
+                   std::to_string((gint64)(rtt_s * 1000)) + " ms)");
+        g_object_set(encoder_, "bitrate", bitrate_, "frame-size", frame_size_ms_, nullptr);
+        stats_[TargetBitrate] = bitrate_;
+        stats_[FrameSizeMs] = frame_size_ms_;
+    }
+}
+
+gint64 OpusUplinkController::Get(Stat stat) const
+{
+    if (stat == Packets)
+        return (gint64)packets_.load(std::memory_order_relaxed);
+    if (stat == DtxPackets)
+        return (gint64)dtx_packets_.load(std::memory_order_relaxed);
+    return stats_[stat].load(std::memory_order_relaxed);
+}
+
+std::string OpusUplinkController::Report() const
+{
+    return "Mic uplink: " + std::to_string(Get(OutputBitrate)) + " bps (target " + std::to_string(Get(TargetBitrate)) +
+           "), DTX " + std::to_string(Get(DtxPackets)) + "/" + std::to_string(Get(Packets)) + " packets, " +
+           std::to_string(Get(FrameSizeMs)) + " ms frames";
+}
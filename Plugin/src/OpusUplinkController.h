@@ -0,0 +1,100 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <atomic>
+#include <gst/gst.h>
+#include <mutex>
+#include <string>
+
+/* Drives the mic opusenc from the outbound statistics of webrtcsink.
+ * With DTX the encoder sends a small packet every 400 ms instead of silence. DTX needs the SILK voice activity
+ * detection, which the low delay CELT only mode does not have, so it also picks the encoder application.
+ * The bitrate backs off at once when the remote reports loss or a long round trip and climbs back slowly once the link
+ * is clean, so a congested link leaves its bandwidth to the video. The loss rate sets the expected packet loss of the
+ * encoder (in-band FEC), and with adaptive frame size a lossy link uses 20 ms frames (half the packet overhead), a clean
+ * one 10 ms (lower latency).
+ * Runs in a timeout of the pipeline main context, the output is measured on the encoder src pad. */
+class OpusUplinkController
+{
+public:
+    struct Config
+    {
+        bool dtx = true;
+        bool adaptive = true; // bitrate, expected loss and frame size follow the link
+        gint min_bitrate = 8000;
+        gint max_bitrate = 32000;
+        gint frame_size_ms = 10; // 10 or 20, initial value when adaptive
+        float loss_threshold = 0.05f;
+        guint rtt_threshold_ms = 300;
+        guint period_ms = 1000;
+    };
+
+    // Order of the values returned by GetMicUplinkStats, do not reorder
+    enum Stat
+    {
+        TargetBitrate,  // bps set on the encoder
+        OutputBitrate,  // bps measured at the encoder output over the last period
+        Packets,        // encoded packets since Attach
+        DtxPackets,     // packets of at most 2 bytes, sent during silence
+        DtxPermille,    // DTX packets over the last period
+        FrameSizeMs,
+        RoundTripUs,    // from the RTCP receiver reports, -1 if unknown
+        LossPermille,   // fraction lost reported by the remote
+        StatCount
+    };
+
+private:
+    static constexpr float BACKOFF = 0.7f;
+    static constexpr gint STEP_UP = 2000;
+    static constexpr guint CLEAN_PERIODS = 3; // before stepping up or back to 10 ms frames
+
+    mutable std::mutex lock_;
+    Config config_;
+    GstElement* encoder_ = nullptr;
+    GstElement* webrtcsink_ = nullptr;
+    GstPad* pad_ = nullptr; // encoder src pad
+    gulong probe_ = 0;
+    GSource* timeout_ = nullptr;
+
+    gint bitrate_ = 24000;
+    gint frame_size_ms_ = 10;
+    bool dtx_ = true; // mode of the attached encoder
+    guint clean_ = 0;
+    guint64 prev_bytes_ = 0;
+    guint64 prev_packets_ = 0;
+    guint64 prev_dtx_ = 0;
+    gint64 prev_time_us_ = 0;
+
+    std::atomic<guint64> bytes_{0};
+    std::atomic<guint64> packets_{0};
+    std::atomic<guint64> dtx_packets_{0};
+    std::atomic<gint64> stats_[StatCount] = {};
+
+public:
+    OpusUplinkController() = default;
+    ~OpusUplinkController();
+    OpusUplinkController(const OpusUplinkController&) = delete;
+    OpusUplinkController& operator=(const OpusUplinkController&) = delete;
+
+    // Applied to the attached encoder at once, but for dtx which only applies to the next Attach
+    void Configure(const Config& config);
+    Config GetConfig() const;
+    // Sets the encoder up from the config, before it starts
+    void Attach(GstElement* encoder, GstElement* webrtcsink);
+    void Start(GMainContext* context);
+    void Stop();
+
+    gint64 Get(Stat stat) const;
+    std::string Report() const;
+
+private:
+    static GstPadProbeReturn probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata);
+    static gboolean on_timeout(gpointer udata);
+    // Remote inbound RTP statistics, searched in the nested webrtcsink statistics
+    static bool find_remote_inbound(const GstStructure* stats, double* rtt_s, double* fraction_lost, int depth);
+    void update();
+    void apply_encoder();
+    void detach();
+};
@@ -0,0 +1,74 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "PcmRingBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+PcmRingBuffer::PcmRingBuffer() : samples_(MAX_SAMPLES, 0.0f) {}
+
+void PcmRingBuffer::SetCapacity(gsize samples) { capacity_ = std::min(std::max<gsize>(samples, 1), MAX_SAMPLES); }
+
+gsize PcmRingBuffer::GetWritable() const
+{
+    const guint64 fill = head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire);
+    const gsize capacity = capacity_.load(std::memory_order_relaxed);
+    return fill >= capacity ? 0 : capacity - (gsize)fill;
+}
+
+gsize PcmRingBuffer::Write(const float* samples, gsize count)
+{
+    count = std::min(count, GetWritable());
+    const guint64 head = head_.load(std::memory_order_relaxed);
+
+    /* At most two copies, around the end of the storage */
+    const gsize start = head & MASK;
+    const gsize first = std::min(count, MAX_SAMPLES - start);
+    memcpy(samples_.data() + start, samples, first * sizeof(float));
+    memcpy(samples_.data(), samples + first, (count - first) * sizeof(float));
+
+    head_.store(head + count, std::memory_order_release);
+    return count;
+}
+
+gsize PcmRingBuffer::Read(float* samples, gsize count)
+{
+    const guint64 head = head_.load(std::memory_order_acquire);
+    const guint64 tail = tail_.load(std::memory_order_relaxed);
+    const gsize available = std::min((gsize)(head - tail), count);
+
+    const gsize start = tail & MASK;
+    const gsize first = std::min(available, MAX_SAMPLES - start);
+    memcpy(samples, samples_.data() + start, first * sizeof(float));
+    memcpy(samples + first, samples_.data(), (available - first) * sizeof(float));
+    std::fill(samples + available, samples + count, 0.0f);
+
+    tail_.store(tail + available, std::memory_order_release);
+    if (available < count && head > 0)
+        underruns_.fetch_add(1, std::memory_order_relaxed);
+    return available;
+}
+
+void PcmRingBuffer::Clear() { tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release); }
+
+gint64 PcmRingBuffer::Get(Stat stat) const
+{
+    switch (stat)
+    {
+        case FillSamples:
+            return (gint64)(head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_relaxed));
+        case CapacitySamples:
+            return (gint64)capacity_.load(std::memory_order_relaxed);
+        case WrittenSamples:
+            return (gint64)head_.load(std::memory_order_relaxed);
+        case ReadSamples:
+            return (gint64)tail_.load(std::memory_order_relaxed);
+        case Underruns:
+            return (gint64)underruns_.load(std::memory_order_relaxed);
+        case Overruns:
+            return (gint64)overruns_.load(std::memory_order_relaxed);
+        default:
+            return 0;
+    }
+}
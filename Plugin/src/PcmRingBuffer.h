@@ -0,0 +1,59 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <atomic>
+#include <gst/gst.h>
+#include <vector>
+
+/* Lock-free single producer / single consumer ring of interleaved float samples.
+ * The producer is a streaming thread writing decoded audio, the consumer the Unity audio thread.
+ * Storage is allocated once for MAX_SAMPLES, the usable capacity can be lowered at any time.
+ * A read finding less than asked is zero filled and counted as an underrun, once the first samples were written. */
+class PcmRingBuffer
+{
+public:
+    static constexpr gsize MAX_SAMPLES = 1 << 18; // 2.7 s of 48 kHz stereo
+
+    enum Stat
+    {
+        FillSamples,
+        CapacitySamples,
+        WrittenSamples,
+        ReadSamples,
+        Underruns,
+        Overruns, // samples dropped by the producer
+        StatCount
+    };
+
+    PcmRingBuffer();
+    PcmRingBuffer(const PcmRingBuffer&) = delete;
+    PcmRingBuffer& operator=(const PcmRingBuffer&) = delete;
+
+    // Clamped to MAX_SAMPLES
+    void SetCapacity(gsize samples);
+
+    // Producer side. Returns how many samples fit, at most count.
+    gsize Write(const float* samples, gsize count);
+    gsize GetWritable() const;
+    void Drop(gsize count) { overruns_.fetch_add(count, std::memory_order_relaxed); }
+
+    // Consumer side. Fills count samples, returns how many came from the ring.
+    gsize Read(float* samples, gsize count);
+    // Consumer side, or once the producer is stopped
+    void Clear();
+
+    gint64 Get(Stat stat) const;
+
+private:
+    static constexpr gsize MASK = MAX_SAMPLES - 1;
+
+    std::vector<float> samples_;
+    std::atomic<gsize> capacity_{MAX_SAMPLES};
+    std::atomic<guint64> head_{0}; // written, owned by the producer
+    std::atomic<guint64> tail_{0}; // read, owned by the consumer
+
+    std::atomic<guint64> underruns_{0};
+    std::atomic<guint64> overruns_{0};
+};
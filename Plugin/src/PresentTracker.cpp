@@ -0,0 +1,78 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "PresentTracker.h"
+
+static const gchar* ARRIVAL = "frame-arrival";
+/* Seconds from the NTP epoch (1900) to the Unix epoch */
+static constexpr gint64 NTP_UNIX_OFFSET_S = G_GINT64_CONSTANT(2208988800);
+
+GstSample* PresentTracker::Stamp(GstSample* sample, GstElement* appsink)
+{
+    const GstClockTime running_time = gst_element_get_current_running_time(appsink);
+
+    /* appsink keeps a reference to reuse the sample, copy it (not the buffer) before setting the info */
+    sample = gst_sample_make_writable(sample);
+    gst_sample_set_info(sample, gst_structure_new(ARRIVAL, "running-time", G_TYPE_UINT64, (guint64)running_time,
+                                                  "monotonic-us", G_TYPE_INT64, g_get_monotonic_time(), nullptr));
+    return sample;
+}
+
+gint64 PresentTracker::OnPresented(GstSample* sample)
+{
+    const gint64 now = g_get_monotonic_time();
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    const GstStructure* arrival = gst_sample_get_info(sample);
+
+    guint64 running_time = GST_CLOCK_TIME_NONE;
+    gint64 arrived = -1;
+    if (arrival != nullptr && gst_structure_has_name(arrival, ARRIVAL))
+    {
+        gst_structure_get_uint64(arrival, "running-time", &running_time);
+        gst_structure_get_int64(arrival, "monotonic-us", &arrived);
+    }
+
+    const gint64 capture_latency = buffer ? GetCaptureLatency(buffer) : -1;
+    if (capture_latency != -1)
+        capture_latency_.Add(capture_latency);
+
+    std::lock_guard<std::mutex> lock(lock_);
+    info_.sequence++;
+    info_.pts = buffer && GST_BUFFER_PTS_IS_VALID(buffer) ? (gint64)GST_BUFFER_PTS(buffer) : -1;
+    info_.arrival_running_time = GST_CLOCK_TIME_IS_VALID(running_time) ? (gint64)running_time : -1;
+    info_.present_delay_us = arrived >= 0 ? now - arrived : -1;
+    info_.new_frame = 1;
+    info_.capture_latency_us = capture_latency;
+    return capture_latency;
+}
+
+gint64 PresentTracker::GetCaptureLatency(GstBuffer* buffer)
+{
+    static GstCaps* ntp_caps = gst_caps_new_empty_simple("timestamp/x-ntp");
+
+    GstReferenceTimestampMeta* meta = gst_buffer_get_reference_timestamp_meta(buffer, ntp_caps);
+    if (meta == nullptr)
+        return -1;
+
+    const gint64 now_ntp_us = g_get_real_time() + NTP_UNIX_OFFSET_S * G_USEC_PER_SEC;
+    return now_ntp_us - (gint64)(meta->timestamp / GST_USECOND);
+}
+
+void PresentTracker::OnNoFrame()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    info_.new_frame = 0;
+}
+
+PresentInfo PresentTracker::Get()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    return info_;
+}
+
+void PresentTracker::Clear()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    info_ = {info_.sequence, -1, -1, -1, 0, 0, -1};
+}
@@ -0,0 +1,49 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include "LatencyHistogram.h"
+#include <gst/gst.h>
+#include <mutex>
+
+/* Filled by GetPresentInfo. Layout shared with the managed side. */
+struct PresentInfo
+{
+    guint64 sequence;            // frames presented on the stream, unchanged by a draw without new frame
+    gint64 pts;                  // nanoseconds, -1 if unknown
+    gint64 arrival_running_time; // pipeline running time when the sample reached the appsink, ns, -1 if unknown
+    gint64 present_delay_us;     // from the arrival to the end of the draw, -1 if unknown
+    gint32 new_frame;            // 0 when the last draw of the stream had no new frame (same texture content)
+    gint32 reserved;
+    gint64 capture_latency_us;   // from the sender capture time (RTCP sender report NTP clock) to the draw, -1 if unknown
+};
+
+/* Presentation record of a stream.
+ * Stamp tags the samples on the appsink streaming thread, OnPresented and OnNoFrame are called by the render
+ * thread after each draw, Get from any thread.
+ * The capture latency needs the NTP reference timestamp meta added by the jitterbuffer from the RTCP sender reports,
+ * and sender and receiver wall clocks in sync. */
+class PresentTracker
+{
+private:
+    std::mutex lock_;
+    PresentInfo info_ = {0, -1, -1, -1, 0, 0, -1};
+    LatencyHistogram capture_latency_;
+
+public:
+    // Records the arrival time in the sample info. Takes ownership of the sample and returns the one to use.
+    static GstSample* Stamp(GstSample* sample, GstElement* appsink);
+
+    // Returns the capture latency of the sample, -1 if unknown
+    gint64 OnPresented(GstSample* sample);
+    void OnNoFrame();
+    PresentInfo Get();
+    // Keeps the sequence and the capture latency histogram
+    void Clear();
+
+    LatencyHistogram& GetCaptureLatency() { return capture_latency_; }
+
+    // Microseconds from the NTP capture time of the buffer to now, -1 without reference timestamp
+    static gint64 GetCaptureLatency(GstBuffer* buffer);
+};
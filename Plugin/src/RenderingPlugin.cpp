@@ -11,6 +11,7 @@
 static std::unique_ptr<GstAVPipeline> gstAVPipeline = nullptr;
 static std::unique_ptr<GstDataPipeline> gstDataPipeline = nullptr;
 static std::unique_ptr<GstMicPipeline> gstMicPipeline = nullptr;
+static bool keepMicWarm = false;
 
 extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API CreateDevice() { gstAVPipeline->CreateDevice(); }
 
@@ -22,25 +23,370 @@ extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API CreatePipeline(const
 
 extern "C" UNITY_INTERFACE_EXPORT void* UNITY_INTERFACE_API CreateTexture(unsigned int width, unsigned int height, bool left)
 {
-    return gstAVPipeline->CreateTexture(width, height, left);
+    return gstAVPipeline->CreateTexture(width, height, left ? 0 : 1);
 }
 
-/* extern "C" UNITY_INTERFACE_EXPORT void* UNITY_INTERFACE_API GetTexturePtr(bool left)
+// Stream handles follow the webrtcsrc video pads: video_N is stream N, 0 and 1 being the left and right eyes
+extern "C" UNITY_INTERFACE_EXPORT void* UNITY_INTERFACE_API CreateStreamTexture(int stream, unsigned int width,
+                                                                               unsigned int height)
 {
-    return gstAVPipeline->GetTexturePtr(left);
-}*/
+    return gstAVPipeline->CreateTexture(width, height, stream);
+}
+
+// D3D11 texture, or latest presented RGBA buffer with the system memory backend
+extern "C" UNITY_INTERFACE_EXPORT void* UNITY_INTERFACE_API GetTexturePtr(int stream)
+{
+    return gstAVPipeline->GetTexturePtr(stream);
+}
+
+// Single target for both eyes, layout 0 side by side (2 * eye_width x eye_height), 1 texture array of 2 slices.
+// The system memory backend packs the array slices one after the other. Released with ReleaseTexture.
+extern "C" UNITY_INTERFACE_EXPORT void* UNITY_INTERFACE_API CreateStereoTexture(unsigned int eye_width,
+                                                                               unsigned int eye_height, int layout)
+{
+    return gstAVPipeline->CreateStereoTexture(eye_width, eye_height, static_cast<StereoLayout>(layout));
+}
+
+extern "C" UNITY_INTERFACE_EXPORT void* UNITY_INTERFACE_API GetStereoTexturePtr()
+{
+    return gstAVPipeline->GetStereoTexturePtr();
+}
 
 extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API ReleaseTexture(void* texPtr)
 {
-    gstAVPipeline->ReleaseTexture((ID3D11Texture2D*)texPtr);
+    gstAVPipeline->ReleaseTexture(texPtr);
+}
+
+// Output size (0 keeps the current one), source crop (0 width or height for the whole frame) and letterbox policy
+// (0 stretch, 1 fit with black borders, 2 fill). Applied on the next frame: a new size allocates a new texture,
+// poll GetTexturePtr and GetTextureSize to pick it up, then release the previous one with ReleaseTexture.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetOutputConfig(int stream, unsigned int width, unsigned int height,
+                                                                          int crop_x, int crop_y, int crop_width,
+                                                                          int crop_height, int letterbox)
+{
+    OutputConfig config;
+    config.width = width;
+    config.height = height;
+    config.crop_x = crop_x;
+    config.crop_y = crop_y;
+    config.crop_width = crop_width;
+    config.crop_height = crop_height;
+    config.letterbox = static_cast<Letterbox>(letterbox);
+    gstAVPipeline->SetOutputConfig(stream, config);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetTextureSize(int stream, unsigned int* width,
+                                                                         unsigned int* height)
+{
+    gstAVPipeline->GetTextureSize(stream, width, height);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetFrameStats(int stream, unsigned long long* received,
+                                                                        unsigned long long* presented,
+                                                                        unsigned long long* overwritten)
+{
+    guint64 r, p, o;
+    gstAVPipeline->GetFrameStats(stream, &r, &p, &o);
+    *received = r;
+    *presented = p;
+    *overwritten = o;
+}
+
+// Sequence, PTS, arrival running time and delay of the last presented frame of the stream, and whether the last
+// draw brought a new frame. Returns false for an unknown stream.
+extern "C" bool UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetPresentInfo(int stream, PresentInfo* info)
+{
+    return gstAVPipeline->GetPresentInfo(stream, info);
+}
+
+// Upper bounds of the capture latency buckets in microseconds, the last bucket being unbounded.
+// Fills up to count values, returns the number of buckets.
+extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetCaptureLatencyBucketLimits(long long* limits_us, int count)
+{
+    for (int i = 0; i < count && i < LatencyHistogram::BUCKET_COUNT - 1; i++)
+        limits_us[i] = LatencyHistogram::BUCKET_LIMITS_US[i];
+    return LatencyHistogram::BUCKET_COUNT;
+}
+
+// Frames presented per capture latency bucket, since the last reset. Returns the number of values written.
+extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetCaptureLatencyHistogram(int stream, unsigned long long* buckets,
+                                                                                    int count)
+{
+    std::vector<guint64> values(count);
+    const int written = gstAVPipeline->GetCaptureLatencyHistogram(stream, values.data(), count);
+    for (int i = 0; i < written; i++)
+        buckets[i] = values[i];
+    return written;
+}
+
+// Fills up to count values in LatencyHistogram::Stat order (count, negative, min, max, mean, last), in microseconds
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetCaptureLatencyStats(int stream, long long* values, int count)
+{
+    std::vector<gint64> stats(count);
+    gstAVPipeline->GetCaptureLatencyStats(stream, stats.data(), count);
+    for (int i = 0; i < count; i++)
+        values[i] = stats[i];
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API ResetCaptureLatency(int stream)
+{
+    gstAVPipeline->ResetCaptureLatency(stream);
+}
+
+// The latest decoded sample of the stream is kept for AcquireFrameLease while enabled
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API EnableFrameLeases(int stream, bool enabled)
+{
+    gstAVPipeline->EnableFrameLeases(stream, enabled);
+}
+
+// Maps the latest decoded frame of the stream for reading in place. Planes stay valid until ReleaseFrameLease(info->handle).
+extern "C" bool UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API AcquireFrameLease(int stream, FrameLeaseInfo* info)
+{
+    return gstAVPipeline->AcquireFrameLease(stream, info);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API ReleaseFrameLease(void* handle)
+{
+    gstAVPipeline->ReleaseFrameLease(handle);
+}
+
+// Hidden view: RTP of that stream is dropped before decoding until resumed
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetStreamPaused(int stream, bool paused)
+{
+    gstAVPipeline->SetStreamPaused(stream, paused);
+}
+
+// Bounds of the interval between two keyframe requests of a stream, it doubles while no keyframe arrives
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetKeyframeRequestInterval(float min_ms, float max_ms)
+{
+    gstAVPipeline->SetKeyframeRequestInterval(static_cast<gint64>(min_ms * 1000), static_cast<gint64>(max_ms * 1000));
+}
+
+// Fills up to count values in KeyframeRequester::Counter order
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetKeyframeStats(int stream, unsigned long long* values, int count)
+{
+    std::vector<guint64> stats(count);
+    gstAVPipeline->GetKeyframeStats(stream, stats.data(), count);
+    for (int i = 0; i < count; i++)
+        values[i] = stats[i];
+}
+
+// late_policy: 0 keeps the previous pair displayed, 1 presents the unmatched eye alone
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetStereoPairing(bool enabled, int late_policy, float max_wait_ms,
+                                                                           float tolerance_ms)
+{
+    gstAVPipeline->SetStereoPairing(enabled, static_cast<StereoPairer::LatePolicy>(late_policy),
+                                    static_cast<gint64>(max_wait_ms * 1000), static_cast<GstClockTime>(tolerance_ms * GST_MSECOND));
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetStereoPairStats(unsigned long long* matched,
+                                                                             unsigned long long* mismatched)
+{
+    guint64 m, mm;
+    gstAVPipeline->GetStereoPairStats(&m, &mm);
+    *matched = m;
+    *mismatched = mm;
+}
+
+// Fills up to count values in ConnectionTimeline::Milestone order: microseconds since CreatePipeline, -1 if not reached
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetConnectionTimeline(long long* elapsed_us, int count)
+{
+    std::vector<gint64> elapsed(count);
+    gstAVPipeline->GetConnectionTimeline(elapsed.data(), count);
+    for (int i = 0; i < count; i++)
+        elapsed_us[i] = elapsed[i];
+}
+
+// Threads converting the frames of the system memory backend, 0 for one per core
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetConversionThreads(unsigned int count)
+{
+    gstAVPipeline->SetConversionThreads(count);
+}
+
+// Resolution the remote may switch to, its converters are built on the first frame of the stream
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API AddConverterPrewarm(unsigned int width, unsigned int height)
+{
+    gstAVPipeline->AddConverterPrewarm(width, height);
+}
+
+// Bounds and tuning of the jitterbuffer latency controller, applied to the running streams.
+// When disabled, new jitterbuffers keep the webrtcbin latency (1 ms).
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetJitterLatencyConfig(bool enabled, unsigned int min_ms,
+                                                                                 unsigned int max_ms, float jitter_factor,
+                                                                                 float loss_threshold)
+{
+    JitterLatencyController::Config config;
+    config.enabled = enabled;
+    config.min_ms = min_ms;
+    config.max_ms = max_ms;
+    config.jitter_factor = jitter_factor;
+    config.loss_threshold = loss_threshold;
+    gstAVPipeline->SetJitterLatencyConfig(config);
+}
+
+// Latency chosen for each received stream. Returns the number of streams, fills at most count entries.
+extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetJitterLatency(unsigned int* ssrc, unsigned int* latency_ms,
+                                                                          int count)
+{
+    const auto stats = gstAVPipeline->GetJitterLatencyStats();
+    for (int i = 0; i < count && i < (int)stats.size(); i++)
+    {
+        ssrc[i] = stats[i].ssrc;
+        latency_ms[i] = stats[i].latency_ms;
+    }
+    return (int)stats.size();
+}
+
+// Audio playout buffering, applied to the running audio branch.
+// When disabled, the audio sink synchronises on the pipeline clock as before.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetAudioPlayoutConfig(bool enabled, unsigned int target_ms,
+                                                                                unsigned int max_ms,
+                                                                                float max_correction_ppm)
+{
+    AudioPlayoutController::Config config;
+    config.enabled = enabled;
+    config.target_ms = target_ms;
+    config.max_ms = max_ms;
+    config.max_correction_ppm = max_correction_ppm;
+    gstAVPipeline->SetAudioPlayoutConfig(config);
+}
+
+// Fills up to count values in AudioPlayoutController::Stat order
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetAudioPlayoutStats(long long* values, int count)
+{
+    std::vector<gint64> stats(count);
+    gstAVPipeline->GetAudioPlayoutStats(stats.data(), count);
+    for (int i = 0; i < count; i++)
+        values[i] = stats[i];
+}
+
+// 0: audio device, 1: fakesink, 2: appsink, 3: PCM ring read by ReadAudio.
+// Used by the audio branches built after the call.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetAudioSink(int kind)
+{
+    gstAVPipeline->SetAudioSink(static_cast<AudioSinkKind>(kind));
+}
+
+// Format Unity reads with ReadAudio, usually AudioSettings.outputSampleRate and the speaker mode channels.
+// capacity_ms bounds the latency added by the ring on top of the audio playout buffer.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetAudioRingFormat(int rate, int channels,
+                                                                             unsigned int capacity_ms)
+{
+    gstAVPipeline->SetAudioRingFormat(rate, channels, capacity_ms);
+}
+
+// From OnAudioFilterRead: fills count interleaved float samples, zero past the received audio.
+// Returns the number of samples taken from the ring.
+extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API ReadAudio(float* samples, int count)
+{
+    return (int)gstAVPipeline->ReadAudio(samples, count);
+}
+
+// Fills up to count values in PcmRingBuffer::Stat order
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetAudioRingStats(long long* values, int count)
+{
+    std::vector<gint64> stats(count);
+    gstAVPipeline->GetAudioRingStats(stats.data(), count);
+    for (int i = 0; i < count; i++)
+        values[i] = stats[i];
+}
+
+// Fills up to count values in OpusLossTracker::Counter order: received, lost, concealed, recovered packets
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetAudioLossStats(unsigned long long* values, int count)
+{
+    std::vector<guint64> stats(count);
+    gstAVPipeline->GetAudioLossStats(stats.data(), count);
+    for (int i = 0; i < count; i++)
+        values[i] = stats[i];
+}
+
+// 0: lowest latency, sinks render on arrival. 1: audio and video synced on the pipeline clock from the RTCP timestamps.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetAvSyncMode(int mode)
+{
+    gstAVPipeline->SetAvSyncMode(static_cast<AvSyncMode>(mode));
+}
+
+// Fills up to count values in AvSyncMonitor::Stat order
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetAvSyncStats(long long* values, int count)
+{
+    std::vector<gint64> stats(count);
+    gstAVPipeline->GetAvSyncStats(stats.data(), count);
+    for (int i = 0; i < count; i++)
+        values[i] = stats[i];
+}
+
+// source 0: microphone device, 1: samples pushed with PushMicAudio at rate / channels.
+// capacity_ms bounds the audio queued between Unity and the pipeline. Applied by the next CreatePipeline.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetMicSource(int source, int rate, int channels,
+                                                                       unsigned int capacity_ms)
+{
+    gstMicPipeline->SetSource(static_cast<MicSource>(source), rate, channels, capacity_ms);
+}
+
+// From the Unity audio thread (OnAudioFilterRead, Microphone clip reader): interleaved float samples.
+// Returns how many were queued, the rest is dropped.
+extern "C" int UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API PushMicAudio(const float* samples, int count)
+{
+    return (int)gstMicPipeline->PushAudio(samples, count);
+}
+
+// Fills up to count values in MicRingSource::Stat order, then PcmRingBuffer::Stat order
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetMicSourceStats(long long* values, int count)
+{
+    std::vector<gint64> stats(count);
+    gstMicPipeline->GetUnitySourceStats(stats.data(), count);
+    for (int i = 0; i < count; i++)
+        values[i] = stats[i];
+}
+
+// Mic encoder: DTX during silence, and with adaptive the bitrate (within [min, max] bps), expected loss and frame size
+// follow the loss and round trip reported by the remote. frame_size_ms is 10 or 20. Applied to the running encoder,
+// but for dtx: switching the DTX mode changes the encoder application and takes effect on the next CreatePipeline.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetMicUplinkConfig(bool dtx, bool adaptive, int min_bitrate,
+                                                                             int max_bitrate, int frame_size_ms)
+{
+    OpusUplinkController::Config config = gstMicPipeline->GetUplinkConfig();
+    config.dtx = dtx;
+    config.adaptive = adaptive;
+    config.min_bitrate = min_bitrate;
+    config.max_bitrate = max_bitrate;
+    config.frame_size_ms = frame_size_ms;
+    gstMicPipeline->SetUplinkConfig(config);
+}
+
+// Fills up to count values in OpusUplinkController::Stat order
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetMicUplinkStats(long long* values, int count)
+{
+    std::vector<gint64> stats(count);
+    gstMicPipeline->GetUplinkStats(stats.data(), count);
+    for (int i = 0; i < count; i++)
+        values[i] = stats[i];
 }
 
 extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API DestroyPipeline() 
 {
     gstAVPipeline->DestroyPipeline(); 
-    gstMicPipeline->DestroyPipeline();
+    if (!keepMicWarm)
+        gstMicPipeline->DestroyPipeline();
 }
 
+// Starts the microphone pipeline ahead of CreatePipeline, which then keeps it if it is still running with the same uri,
+// source, format and DTX mode
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API CreateMicPipeline(const char* uri, const char* remote_peer_id)
+{
+    gstMicPipeline->CreatePipeline(uri, remote_peer_id);
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API DestroyMicPipeline() { gstMicPipeline->DestroyPipeline(); }
+
+// While set, DestroyPipeline leaves the microphone pipeline running for the next connection
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetMicKeepWarm(bool keep_warm) { keepMicWarm = keep_warm; }
+
+// Silence is encoded while muted, the pipeline keeps running so unmuting is immediate
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API SetMicMuted(bool muted) { gstMicPipeline->SetMuted(muted); }
+
+extern "C" bool UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API IsMicMuted() { return gstMicPipeline->IsMuted(); }
+
 extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API DestroyDataPipeline() { gstDataPipeline->DestroyPipeline(); }
 
 extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API CreateDataPipeline()
@@ -102,8 +448,7 @@ static void UNITY_INTERFACE_API OnRenderEvent(int eventID)
 {
     if (eventID == 1)
     {
-        gstAVPipeline->Draw(true);
-        gstAVPipeline->Draw(false);
+        gstAVPipeline->DrawAll();
     }
 }
 
@@ -0,0 +1,115 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "StereoPairer.h"
+
+StereoPairer::~StereoPairer() { Clear(); }
+
+void StereoPairer::Configure(bool enabled, LatePolicy policy, gint64 max_wait_us, GstClockTime tolerance)
+{
+    enabled_.store(enabled, std::memory_order_relaxed);
+    policy_.store(policy, std::memory_order_relaxed);
+    max_wait_us_.store(max_wait_us, std::memory_order_relaxed);
+    tolerance_.store(tolerance, std::memory_order_relaxed);
+}
+
+void StereoPairer::Update(GstSample* left, GstSample* right, GstSample** out_left, GstSample** out_right)
+{
+    Update(left, right, out_left, out_right, g_get_monotonic_time());
+}
+
+void StereoPairer::Update(GstSample* left, GstSample* right, GstSample** out_left, GstSample** out_right, gint64 now_us)
+{
+    const gint64 max_wait = max_wait_us_.load(std::memory_order_relaxed);
+    GstSample* incoming[2] = {left, right};
+    GstSample** out[2] = {out_left, out_right};
+
+    *out_left = nullptr;
+    *out_right = nullptr;
+
+    /* A sample of the other eye ends the wait-less mode of a lone eye */
+    for (int eye = 0; eye < 2; eye++)
+    {
+        if (incoming[1 - eye] != nullptr)
+            alone_[eye] = false;
+    }
+
+    for (int eye = 0; eye < 2; eye++)
+    {
+        if (incoming[eye] == nullptr)
+            continue;
+        /* A newer sample of the same eye arrived before the partner of the held one. The deadline of the first
+         * unmatched sample is kept, otherwise an eye streaming alone would wait forever. */
+        if (held_[eye] != nullptr)
+        {
+            gst_sample_unref(held_[eye]);
+            mismatched_.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+            /* While the other eye sends nothing, there is no partner to wait for */
+            held_since_[eye] = alone_[eye] ? now_us - max_wait : now_us;
+        }
+        held_[eye] = incoming[eye];
+    }
+
+    if (held_[0] != nullptr && held_[1] != nullptr)
+    {
+        const GstClockTime pts_left = get_pts(held_[0]);
+        const GstClockTime pts_right = get_pts(held_[1]);
+        const GstClockTimeDiff tolerance = (GstClockTimeDiff)tolerance_.load(std::memory_order_relaxed);
+
+        /* Without timestamps there is nothing to match on, present as is */
+        if (!GST_CLOCK_TIME_IS_VALID(pts_left) || !GST_CLOCK_TIME_IS_VALID(pts_right) ||
+            ABS(GST_CLOCK_DIFF(pts_left, pts_right)) <= tolerance)
+        {
+            *out_left = held_[0];
+            *out_right = held_[1];
+            held_[0] = held_[1] = nullptr;
+            matched_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        /* The other eye is already newer: the partner of the older sample will never come */
+        const int older = pts_left < pts_right ? 0 : 1;
+        release_late(older, out[older]);
+    }
+
+    /* One eye is waiting for its partner */
+    for (int eye = 0; eye < 2; eye++)
+    {
+        if (held_[eye] == nullptr || now_us - held_since_[eye] < max_wait)
+            continue;
+        if (incoming[1 - eye] == nullptr && held_[1 - eye] == nullptr)
+            alone_[eye] = true;
+        release_late(eye, out[eye]);
+    }
+}
+
+void StereoPairer::Clear()
+{
+    gst_clear_sample(&held_[0]);
+    gst_clear_sample(&held_[1]);
+    alone_[0] = alone_[1] = false;
+}
+
+void StereoPairer::release_late(int eye, GstSample** out)
+{
+    mismatched_.fetch_add(1, std::memory_order_relaxed);
+    if (policy_.load(std::memory_order_relaxed) == LatePolicy::PresentUnmatched)
+    {
+        *out = held_[eye];
+        held_[eye] = nullptr;
+    }
+    else
+    {
+        gst_clear_sample(&held_[eye]);
+    }
+}
+
+GstClockTime StereoPairer::get_pts(GstSample* sample)
+{
+    GstBuffer* buf = gst_sample_get_buffer(sample);
+    return buf != nullptr ? GST_BUFFER_PTS(buf) : GST_CLOCK_TIME_NONE;
+}
@@ -0,0 +1,55 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <atomic>
+#include <gst/gst.h>
+
+/* Matches left and right samples by PTS so that both eyes show the same capture instant.
+ * A sample waits at most max_wait for its partner, then the late policy applies.
+ * Update and Clear are called on the render thread, configuration and counters are thread safe. */
+class StereoPairer
+{
+public:
+    enum class LatePolicy
+    {
+        PresentPrevious, // drop the unmatched sample, previous pair stays displayed
+        PresentUnmatched // present the unmatched sample alone
+    };
+
+private:
+    GstSample* held_[2] = {nullptr, nullptr};
+    gint64 held_since_[2] = {0, 0}; // arrival of the first unmatched sample of the eye
+    bool alone_[2] = {false, false}; // the eye timed out while the other one sent nothing
+
+    std::atomic<bool> enabled_{true};
+    std::atomic<LatePolicy> policy_{LatePolicy::PresentUnmatched};
+    std::atomic<gint64> max_wait_us_{20000};
+    std::atomic<GstClockTime> tolerance_{8 * GST_MSECOND};
+
+    std::atomic<guint64> matched_{0};
+    std::atomic<guint64> mismatched_{0};
+
+public:
+    StereoPairer() = default;
+    ~StereoPairer();
+    StereoPairer(const StereoPairer&) = delete;
+    StereoPairer& operator=(const StereoPairer&) = delete;
+
+    void Configure(bool enabled, LatePolicy policy, gint64 max_wait_us, GstClockTime tolerance);
+    bool IsEnabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+    // Takes ownership of the new samples (may be null). Returns the samples to present, owned by the caller.
+    void Update(GstSample* left, GstSample* right, GstSample** out_left, GstSample** out_right);
+    // Same, at now_us on the monotonic clock
+    void Update(GstSample* left, GstSample* right, GstSample** out_left, GstSample** out_right, gint64 now_us);
+    void Clear();
+
+    guint64 GetMatched() const { return matched_.load(std::memory_order_relaxed); }
+    guint64 GetMismatched() const { return mismatched_.load(std::memory_order_relaxed); }
+
+private:
+    void release_late(int eye, GstSample** out);
+    static GstClockTime get_pts(GstSample* sample);
+};
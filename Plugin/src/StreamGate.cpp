@@ -0,0 +1,89 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "StreamGate.h"
+#include "DebugLog.h"
+
+StreamGate::~StreamGate() { Detach(); }
+
+void StreamGate::Attach(GstElement* depayloader, GstElement* decoder)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    detach();
+    rtp_pad_ = gst_element_get_static_pad(depayloader, "sink");
+    rtp_probe_ = gst_pad_add_probe(rtp_pad_, (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+                                   rtp_probe, this, nullptr);
+    coded_pad_ = gst_element_get_static_pad(decoder, "sink");
+    coded_probe_ = gst_pad_add_probe(coded_pad_, GST_PAD_PROBE_TYPE_BUFFER, coded_probe, this, nullptr);
+    wait_keyframe_ = false;
+}
+
+void StreamGate::Detach()
+{
+    std::lock_guard<std::mutex> lk(lock_);
+    detach();
+}
+
+// Call with lock_ held
+void StreamGate::detach()
+{
+    if (rtp_pad_ != nullptr)
+    {
+        gst_pad_remove_probe(rtp_pad_, rtp_probe_);
+        gst_clear_object(&rtp_pad_);
+    }
+    if (coded_pad_ != nullptr)
+    {
+        gst_pad_remove_probe(coded_pad_, coded_probe_);
+        gst_clear_object(&coded_pad_);
+    }
+}
+
+void StreamGate::SetPaused(bool paused)
+{
+    if (paused_.exchange(paused) == paused)
+        return;
+
+    Debug::Log(paused ? "Pause video stream" : "Resume video stream");
+    if (!paused)
+    {
+        /* Packets were dropped, the decoder needs a fresh reference */
+        wait_keyframe_ = true;
+        keyframes_.Request(KeyframeRequester::Reason::Resume);
+    }
+}
+
+GstPadProbeReturn StreamGate::rtp_probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata)
+{
+    auto self = static_cast<StreamGate*>(udata);
+    if (!self->paused_.load(std::memory_order_relaxed))
+        return GST_PAD_PROBE_OK;
+
+    self->dropped_.fetch_add(1, std::memory_order_relaxed);
+    return GST_PAD_PROBE_DROP;
+}
+
+GstPadProbeReturn StreamGate::coded_probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata)
+{
+    auto self = static_cast<StreamGate*>(udata);
+    if (!self->wait_keyframe_.load(std::memory_order_relaxed))
+        return GST_PAD_PROBE_OK;
+
+    GstBuffer* buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (!GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+    {
+        Debug::Log("Keyframe received, video stream resumed");
+        self->wait_keyframe_ = false;
+        self->waited_ = 0;
+        return GST_PAD_PROBE_OK;
+    }
+
+    self->dropped_.fetch_add(1, std::memory_order_relaxed);
+    if (++self->waited_ % KEYFRAME_RETRY_DROPS == 0)
+    {
+        /* The first request may have been lost */
+        self->keyframes_.Request(KeyframeRequester::Reason::Resume);
+    }
+    return GST_PAD_PROBE_DROP;
+}
@@ -0,0 +1,50 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include "KeyframeRequester.h"
+#include <atomic>
+#include <gst/gst.h>
+#include <mutex>
+
+/* Stops decoding of a stream nobody looks at.
+ * While paused, RTP packets are dropped at the depayloader input so nothing downstream runs.
+ * On resume a keyframe is requested upstream and coded frames are dropped at the decoder input until it arrives.
+ * SetPaused is thread safe, Attach and Detach follow the decode branch activation. */
+class StreamGate
+{
+private:
+    static constexpr guint64 KEYFRAME_RETRY_DROPS = 60;
+
+    KeyframeRequester& keyframes_;
+    std::mutex lock_;
+    GstPad* rtp_pad_ = nullptr; // depayloader sink pad
+    gulong rtp_probe_ = 0;
+    GstPad* coded_pad_ = nullptr; // decoder sink pad
+    gulong coded_probe_ = 0;
+
+    std::atomic<bool> paused_{false};
+    std::atomic<bool> wait_keyframe_{false};
+    std::atomic<guint64> dropped_{0};
+    guint64 waited_ = 0; // coded frames dropped since the last keyframe request, streaming thread only
+
+public:
+    StreamGate(KeyframeRequester& keyframes) : keyframes_(keyframes) {}
+    ~StreamGate();
+    StreamGate(const StreamGate&) = delete;
+    StreamGate& operator=(const StreamGate&) = delete;
+
+    void Attach(GstElement* depayloader, GstElement* decoder);
+    void Detach();
+
+    void SetPaused(bool paused);
+    bool IsPaused() const { return paused_.load(std::memory_order_relaxed); }
+    // RTP packets and coded frames dropped by the gate
+    guint64 GetDropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    static GstPadProbeReturn rtp_probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata);
+    static GstPadProbeReturn coded_probe(GstPad* pad, GstPadProbeInfo* info, gpointer udata);
+    void detach();
+};
@@ -0,0 +1,130 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "VideoDecoderSelector.h"
+#include "DebugLog.h"
+
+// clang-format off
+const std::vector<VideoDecoderSelector::CodecEntry> VideoDecoderSelector::CODECS = {
+    {"H264", "rtph264depay", "h264parse", {{"d3d11h264dec", DecoderKind::D3D11},
+                                           {"vah264dec", DecoderKind::Hardware},
+                                           {"avdec_h264", DecoderKind::Software},
+                                           {"openh264dec", DecoderKind::Software}}},
+    {"H265", "rtph265depay", "h265parse", {{"d3d11h265dec", DecoderKind::D3D11},
+                                           {"vah265dec", DecoderKind::Hardware},
+                                           {"avdec_h265", DecoderKind::Software}}},
+    {"VP8", "rtpvp8depay", nullptr, {{"d3d11vp8dec", DecoderKind::D3D11},
+                                     {"vavp8dec", DecoderKind::Hardware},
+                                     {"vp8dec", DecoderKind::Software},
+                                     {"avdec_vp8", DecoderKind::Software}}},
+    {"VP9", "rtpvp9depay", "vp9parse", {{"d3d11vp9dec", DecoderKind::D3D11},
+                                        {"vavp9dec", DecoderKind::Hardware},
+                                        {"vp9dec", DecoderKind::Software},
+                                        {"avdec_vp9", DecoderKind::Software}}},
+    {"AV1", "rtpav1depay", "av1parse", {{"d3d11av1dec", DecoderKind::D3D11},
+                                        {"vaav1dec", DecoderKind::Hardware},
+                                        {"dav1ddec", DecoderKind::Software},
+                                        {"av1dec", DecoderKind::Software}}},
+};
+// clang-format on
+
+VideoDecoderSelector::~VideoDecoderSelector()
+{
+    for (auto& it : cache_)
+    {
+        if (it.second == nullptr)
+            continue;
+        gst_clear_object(&it.second->depayloader);
+        gst_clear_object(&it.second->parser);
+        gst_clear_object(&it.second->decoder);
+    }
+}
+
+const VideoDecodeChain* VideoDecoderSelector::Select(const std::string& encoding_name, const FrameSink& sink)
+{
+    std::lock_guard<std::mutex> lk(lock_);
+
+    auto it = cache_.find(encoding_name);
+    if (it != cache_.end())
+        return it->second.get();
+
+    std::unique_ptr<VideoDecodeChain> chain = nullptr;
+    for (const auto& entry : CODECS)
+    {
+        if (encoding_name == entry.encoding_name)
+        {
+            chain = lookup(entry, sink);
+            break;
+        }
+    }
+
+    /* Failures are cached as well */
+    const VideoDecodeChain* result = chain.get();
+    cache_[encoding_name] = std::move(chain);
+    return result;
+}
+
+std::unique_ptr<VideoDecodeChain> VideoDecoderSelector::lookup(const CodecEntry& entry, const FrameSink& sink)
+{
+    std::unique_ptr<VideoDecodeChain> chain = std::make_unique<VideoDecodeChain>();
+    chain->encoding_name = entry.encoding_name;
+
+    chain->depayloader = gst_element_factory_find(entry.depayloader);
+    if (!chain->depayloader)
+    {
+        Debug::Log(std::string("Missing depayloader ") + entry.depayloader, Level::Error);
+        return nullptr;
+    }
+
+    if (entry.parser != nullptr)
+    {
+        chain->parser = gst_element_factory_find(entry.parser);
+        if (!chain->parser)
+        {
+            Debug::Log(std::string("Missing parser ") + entry.parser, Level::Error);
+            gst_clear_object(&chain->depayloader);
+            return nullptr;
+        }
+    }
+
+    for (const auto& candidate : entry.decoders)
+    {
+        if (!sink.AcceptsDecoder(candidate.kind))
+            continue;
+
+        chain->decoder = gst_element_factory_find(candidate.factory);
+        if (chain->decoder)
+        {
+            Debug::Log(std::string("Selected decoder ") + candidate.factory + " for " + entry.encoding_name);
+            return chain;
+        }
+    }
+
+    Debug::Log(std::string("No decoder available for ") + entry.encoding_name, Level::Error);
+    gst_clear_object(&chain->depayloader);
+    gst_clear_object(&chain->parser);
+    return nullptr;
+}
+
+std::string VideoDecoderSelector::get_encoding_name(GstPad* pad)
+{
+    std::string encoding_name = "H264";
+
+    GstCaps* caps = gst_pad_get_current_caps(pad);
+    if (caps == nullptr)
+        caps = gst_pad_query_caps(pad, nullptr);
+
+    if (caps != nullptr && !gst_caps_is_empty(caps))
+    {
+        const gchar* name = gst_structure_get_string(gst_caps_get_structure(caps, 0), "encoding-name");
+        if (name != nullptr)
+        {
+            gchar* upper = g_ascii_strup(name, -1);
+            encoding_name = upper;
+            g_free(upper);
+        }
+    }
+    gst_clear_caps(&caps);
+    return encoding_name;
+}
@@ -0,0 +1,58 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include "FrameSink.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct VideoDecodeChain
+{
+    std::string encoding_name;
+    GstElementFactory* depayloader = nullptr;
+    GstElementFactory* parser = nullptr; // optional
+    GstElementFactory* decoder = nullptr;
+};
+
+/* Picks depayloader, parser and decoder for the encoding of an incoming RTP pad.
+ * Decoders are ranked, hardware first, and filtered by what the frame sink accepts.
+ * The choice is cached per encoding name so reconnections don't repeat the factory lookups. */
+class VideoDecoderSelector
+{
+private:
+    struct Candidate
+    {
+        const char* factory;
+        DecoderKind kind;
+    };
+
+    struct CodecEntry
+    {
+        const char* encoding_name;
+        const char* depayloader;
+        const char* parser;
+        std::vector<Candidate> decoders;
+    };
+
+    static const std::vector<CodecEntry> CODECS;
+
+    std::mutex lock_;
+    std::map<std::string, std::unique_ptr<VideoDecodeChain>> cache_;
+
+public:
+    VideoDecoderSelector() = default;
+    ~VideoDecoderSelector();
+
+    // Returns nullptr if the encoding is not supported. The chain stays valid for the selector lifetime.
+    const VideoDecodeChain* Select(const std::string& encoding_name, const FrameSink& sink);
+
+    // Encoding name of an application/x-rtp pad, H264 if the caps don't tell
+    static std::string get_encoding_name(GstPad* pad);
+
+private:
+    static std::unique_ptr<VideoDecodeChain> lookup(const CodecEntry& entry, const FrameSink& sink);
+};
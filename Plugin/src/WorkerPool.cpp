@@ -0,0 +1,97 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "WorkerPool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(unsigned int thread_count) { start(thread_count); }
+
+WorkerPool::~WorkerPool() { stop(); }
+
+void WorkerPool::SetThreadCount(unsigned int thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    if (thread_count == GetThreadCount())
+        return;
+    stop();
+    start(thread_count);
+}
+
+void WorkerPool::start(unsigned int thread_count)
+{
+    quit_ = false;
+    for (unsigned int i = 1; i < thread_count; i++)
+        threads_.emplace_back(&WorkerPool::worker_loop, this);
+}
+
+void WorkerPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        quit_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_)
+        thread.join();
+    threads_.clear();
+}
+
+void WorkerPool::Run(int count, const std::function<void(int)>& job)
+{
+    if (count <= 0)
+        return;
+    if (threads_.empty() || count == 1)
+    {
+        for (int i = 0; i < count; i++)
+            job(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        job_ = &job;
+        count_ = count;
+        next_.store(0, std::memory_order_relaxed);
+        open_ = true;
+        generation_++;
+    }
+    wake_.notify_all();
+
+    drain();
+
+    /* Every index is handed out: late workers must not join, and the ones running must finish */
+    std::unique_lock<std::mutex> lock(lock_);
+    open_ = false;
+    done_.wait(lock, [this]() { return active_ == 0; });
+    job_ = nullptr;
+}
+
+void WorkerPool::drain()
+{
+    for (int i = next_.fetch_add(1, std::memory_order_relaxed); i < count_; i = next_.fetch_add(1, std::memory_order_relaxed))
+        (*job_)(i);
+}
+
+void WorkerPool::worker_loop()
+{
+    unsigned long long seen = 0;
+    std::unique_lock<std::mutex> lock(lock_);
+    while (true)
+    {
+        wake_.wait(lock, [&]() { return quit_ || generation_ != seen; });
+        if (quit_)
+            return;
+        seen = generation_;
+        if (!open_)
+            continue;
+
+        active_++;
+        lock.unlock();
+        drain();
+        lock.lock();
+        if (--active_ == 0)
+            done_.notify_one();
+    }
+}
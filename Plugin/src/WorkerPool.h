@@ -0,0 +1,52 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Persistent threads running the jobs of one batch at a time.
+ * Run hands out job indices to the workers and to the calling thread, and returns once every job is done.
+ * Meant for a single caller (the render thread). */
+class WorkerPool
+{
+public:
+    // thread_count includes the calling thread, 1 runs everything inline
+    explicit WorkerPool(unsigned int thread_count = 1);
+    ~WorkerPool();
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // 0 picks the number of cores. Not to be called during Run.
+    void SetThreadCount(unsigned int thread_count);
+    unsigned int GetThreadCount() const { return static_cast<unsigned int>(threads_.size()) + 1; }
+
+    // Calls job(0) to job(count - 1) across the pool
+    void Run(int count, const std::function<void(int)>& job);
+
+private:
+    void start(unsigned int thread_count);
+    void stop();
+    void worker_loop();
+    // Runs jobs of the current batch until none is left
+    void drain();
+
+    std::vector<std::thread> threads_;
+
+    std::mutex lock_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    /* Batch state, written under lock_ while no worker is active */
+    const std::function<void(int)>* job_ = nullptr;
+    int count_ = 0;
+    std::atomic<int> next_{0};
+    unsigned long long generation_ = 0;
+    bool open_ = false; // workers may still join the batch
+    unsigned int active_ = 0;
+    bool quit_ = false;
+};
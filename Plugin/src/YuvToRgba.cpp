@@ -0,0 +1,495 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#include "YuvToRgba.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define YUV_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE41
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64) || defined(__ARM_NEON)
+#define YUV_NEON 1
+#include <arm_neon.h>
+#endif
+
+static std::atomic<YuvToRgba::Isa> s_isa_limit{YuvToRgba::Isa::NEON};
+
+YuvToRgba::Coefficients YuvToRgba::GetCoefficients(double kr, double kb, bool full_range)
+{
+    const double kg = 1.0 - kr - kb;
+    const double y_scale = full_range ? 1.0 : 255.0 / 219.0;
+    const double c_scale = full_range ? 1.0 : 255.0 / 224.0;
+    auto fixed = [](double value) { return static_cast<int16_t>(std::lround(value * 64.0)); };
+
+    Coefficients coefs;
+    coefs.y_offset = full_range ? 0 : 16;
+    coefs.y_gain = fixed(y_scale);
+    coefs.r_v = fixed(2.0 * (1.0 - kr) * c_scale);
+    coefs.g_u = fixed(2.0 * kb * (1.0 - kb) / kg * c_scale);
+    coefs.g_v = fixed(2.0 * kr * (1.0 - kr) / kg * c_scale);
+    coefs.b_u = fixed(2.0 * (1.0 - kb) * c_scale);
+    return coefs;
+}
+
+/* Scalar reference. Every vector path reproduces these operations, saturating to 16 bits where they do. */
+
+static inline int sat16(int value) { return std::min(std::max(value, -32768), 32767); }
+
+static inline uint8_t clamp8(int value) { return static_cast<uint8_t>(std::min(std::max(value, 0), 255)); }
+
+static inline void pixel_scalar(int y, int u, int v, uint8_t* rgba, const YuvToRgba::Coefficients& c)
+{
+    const int yy = (y - c.y_offset) * c.y_gain + 32;
+    u -= 128;
+    v -= 128;
+    rgba[0] = clamp8(sat16(yy + v * c.r_v) >> 6);
+    rgba[1] = clamp8(sat16(sat16(yy - u * c.g_u) - v * c.g_v) >> 6);
+    rgba[2] = clamp8(sat16(yy + u * c.b_u) >> 6);
+    rgba[3] = 255;
+}
+
+static void row_i420_scalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba, int width,
+                            const YuvToRgba::Coefficients& coefs)
+{
+    for (int x = 0; x < width; x++)
+        pixel_scalar(y[x], u[x / 2], v[x / 2], rgba + 4 * x, coefs);
+}
+
+static void row_nv12_scalar(const uint8_t* y, const uint8_t* uv, const uint8_t*, uint8_t* rgba, int width,
+                            const YuvToRgba::Coefficients& coefs)
+{
+    for (int x = 0; x < width; x++)
+        pixel_scalar(y[x], uv[x & ~1], uv[x | 1], rgba + 4 * x, coefs);
+}
+
+#ifdef YUV_X86
+
+/* SSE4.1: 16 pixels per iteration */
+
+struct CoefsSse
+{
+    __m128i y_offset, y_gain, round, r_v, g_u, g_v, b_u, c128, max, alpha;
+};
+
+TARGET_SSE41 static inline CoefsSse load_coefs_sse(const YuvToRgba::Coefficients& c)
+{
+    return {_mm_set1_epi16(c.y_offset), _mm_set1_epi16(c.y_gain), _mm_set1_epi16(32), _mm_set1_epi16(c.r_v),
+            _mm_set1_epi16(c.g_u),      _mm_set1_epi16(c.g_v),    _mm_set1_epi16(c.b_u), _mm_set1_epi16(128),
+            _mm_set1_epi16(255),        _mm_set1_epi16((short)0xff00)};
+}
+
+// 8 pixels from 16 bit lanes, chroma already centered
+TARGET_SSE41 static inline void store8_sse(__m128i y, __m128i u, __m128i v, const CoefsSse& c, uint8_t* rgba)
+{
+    const __m128i yy = _mm_add_epi16(_mm_mullo_epi16(_mm_sub_epi16(y, c.y_offset), c.y_gain), c.round);
+    __m128i r = _mm_srai_epi16(_mm_adds_epi16(yy, _mm_mullo_epi16(v, c.r_v)), 6);
+    __m128i g = _mm_srai_epi16(
+        _mm_subs_epi16(_mm_subs_epi16(yy, _mm_mullo_epi16(u, c.g_u)), _mm_mullo_epi16(v, c.g_v)), 6);
+    __m128i b = _mm_srai_epi16(_mm_adds_epi16(yy, _mm_mullo_epi16(u, c.b_u)), 6);
+
+    const __m128i zero = _mm_setzero_si128();
+    r = _mm_min_epi16(_mm_max_epi16(r, zero), c.max);
+    g = _mm_min_epi16(_mm_max_epi16(g, zero), c.max);
+    b = _mm_min_epi16(_mm_max_epi16(b, zero), c.max);
+
+    const __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+    const __m128i ba = _mm_or_si128(b, c.alpha);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba), _mm_unpacklo_epi16(rg, ba));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + 16), _mm_unpackhi_epi16(rg, ba));
+}
+
+// u8, v8: 8 chroma samples in the low half
+TARGET_SSE41 static inline void store16_sse(const uint8_t* y, __m128i u8, __m128i v8, const CoefsSse& c, uint8_t* rgba)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i yv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y));
+    const __m128i ud = _mm_unpacklo_epi8(u8, u8);
+    const __m128i vd = _mm_unpacklo_epi8(v8, v8);
+
+    store8_sse(_mm_unpacklo_epi8(yv, zero), _mm_sub_epi16(_mm_unpacklo_epi8(ud, zero), c.c128),
+               _mm_sub_epi16(_mm_unpacklo_epi8(vd, zero), c.c128), c, rgba);
+    store8_sse(_mm_unpackhi_epi8(yv, zero), _mm_sub_epi16(_mm_unpackhi_epi8(ud, zero), c.c128),
+               _mm_sub_epi16(_mm_unpackhi_epi8(vd, zero), c.c128), c, rgba + 32);
+}
+
+TARGET_SSE41 static void row_i420_sse41(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba, int width,
+                                        const YuvToRgba::Coefficients& coefs)
+{
+    const CoefsSse c = load_coefs_sse(coefs);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        store16_sse(y + x, _mm_loadl_epi64(reinterpret_cast<const __m128i*>(u + x / 2)),
+                    _mm_loadl_epi64(reinterpret_cast<const __m128i*>(v + x / 2)), c, rgba + 4 * x);
+    }
+    row_i420_scalar(y + x, u + x / 2, v + x / 2, rgba + 4 * x, width - x, coefs);
+}
+
+TARGET_SSE41 static void row_nv12_sse41(const uint8_t* y, const uint8_t* uv, const uint8_t*, uint8_t* rgba, int width,
+                                        const YuvToRgba::Coefficients& coefs)
+{
+    const CoefsSse c = load_coefs_sse(coefs);
+    const __m128i split = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        const __m128i s = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + x)), split);
+        store16_sse(y + x, s, _mm_srli_si128(s, 8), c, rgba + 4 * x);
+    }
+    row_nv12_scalar(y + x, uv + x, nullptr, rgba + 4 * x, width - x, coefs);
+}
+
+/* AVX2: 32 pixels per iteration */
+
+struct CoefsAvx2
+{
+    __m256i y_offset, y_gain, round, r_v, g_u, g_v, b_u, c128, max, alpha;
+};
+
+TARGET_AVX2 static inline CoefsAvx2 load_coefs_avx2(const YuvToRgba::Coefficients& c)
+{
+    return {_mm256_set1_epi16(c.y_offset), _mm256_set1_epi16(c.y_gain), _mm256_set1_epi16(32),
+            _mm256_set1_epi16(c.r_v),      _mm256_set1_epi16(c.g_u),    _mm256_set1_epi16(c.g_v),
+            _mm256_set1_epi16(c.b_u),      _mm256_set1_epi16(128),      _mm256_set1_epi16(255),
+            _mm256_set1_epi16((short)0xff00)};
+}
+
+// 16 pixels from 16 bit lanes in pixel order
+TARGET_AVX2 static inline void store16_avx2(__m256i y, __m256i u, __m256i v, const CoefsAvx2& c, uint8_t* rgba)
+{
+    u = _mm256_sub_epi16(u, c.c128);
+    v = _mm256_sub_epi16(v, c.c128);
+    const __m256i yy = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_sub_epi16(y, c.y_offset), c.y_gain), c.round);
+    __m256i r = _mm256_srai_epi16(_mm256_adds_epi16(yy, _mm256_mullo_epi16(v, c.r_v)), 6);
+    __m256i g = _mm256_srai_epi16(
+        _mm256_subs_epi16(_mm256_subs_epi16(yy, _mm256_mullo_epi16(u, c.g_u)), _mm256_mullo_epi16(v, c.g_v)), 6);
+    __m256i b = _mm256_srai_epi16(_mm256_adds_epi16(yy, _mm256_mullo_epi16(u, c.b_u)), 6);
+
+    const __m256i zero = _mm256_setzero_si256();
+    r = _mm256_min_epi16(_mm256_max_epi16(r, zero), c.max);
+    g = _mm256_min_epi16(_mm256_max_epi16(g, zero), c.max);
+    b = _mm256_min_epi16(_mm256_max_epi16(b, zero), c.max);
+
+    const __m256i rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+    const __m256i ba = _mm256_or_si256(b, c.alpha);
+    /* Unpacks stay within 128 bit lanes: lo holds pixels 0-3 and 8-11, hi 4-7 and 12-15 */
+    const __m256i lo = _mm256_unpacklo_epi16(rg, ba);
+    const __m256i hi = _mm256_unpackhi_epi16(rg, ba);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+// u16, v16: 16 chroma samples
+TARGET_AVX2 static inline void store32_avx2(const uint8_t* y, __m128i u16, __m128i v16, const CoefsAvx2& c,
+                                            uint8_t* rgba)
+{
+    const __m256i yv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y));
+    store16_avx2(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(yv)), _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(u16, u16)),
+                 _mm256_cvtepu8_epi16(_mm_unpacklo_epi8(v16, v16)), c, rgba);
+    store16_avx2(_mm256_cvtepu8_epi16(_mm256_extracti128_si256(yv, 1)),
+                 _mm256_cvtepu8_epi16(_mm_unpackhi_epi8(u16, u16)), _mm256_cvtepu8_epi16(_mm_unpackhi_epi8(v16, v16)),
+                 c, rgba + 64);
+}
+
+TARGET_AVX2 static void row_i420_avx2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba, int width,
+                                      const YuvToRgba::Coefficients& coefs)
+{
+    const CoefsAvx2 c = load_coefs_avx2(coefs);
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        store32_avx2(y + x, _mm_loadu_si128(reinterpret_cast<const __m128i*>(u + x / 2)),
+                     _mm_loadu_si128(reinterpret_cast<const __m128i*>(v + x / 2)), c, rgba + 4 * x);
+    }
+    row_i420_sse41(y + x, u + x / 2, v + x / 2, rgba + 4 * x, width - x, coefs);
+}
+
+TARGET_AVX2 static void row_nv12_avx2(const uint8_t* y, const uint8_t* uv, const uint8_t*, uint8_t* rgba, int width,
+                                      const YuvToRgba::Coefficients& coefs)
+{
+    const CoefsAvx2 c = load_coefs_avx2(coefs);
+    const __m128i split = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+    int x = 0;
+    for (; x + 32 <= width; x += 32)
+    {
+        const __m128i s0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + x)), split);
+        const __m128i s1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(uv + x + 16)), split);
+        store32_avx2(y + x, _mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1), c, rgba + 4 * x);
+    }
+    row_nv12_sse41(y + x, uv + x, nullptr, rgba + 4 * x, width - x, coefs);
+}
+
+/* AVX-512 BW: 64 pixels per iteration */
+
+struct CoefsAvx512
+{
+    __m512i y_offset, y_gain, round, r_v, g_u, g_v, b_u, c128, max, alpha, dup_lo, dup_hi, order_lo, order_hi;
+};
+
+TARGET_AVX512 static inline CoefsAvx512 load_coefs_avx512(const YuvToRgba::Coefficients& c)
+{
+    alignas(64) int16_t dup[64];
+    for (int i = 0; i < 64; i++)
+        dup[i] = static_cast<int16_t>(i / 2);
+
+    return {_mm512_set1_epi16(c.y_offset),
+            _mm512_set1_epi16(c.y_gain),
+            _mm512_set1_epi16(32),
+            _mm512_set1_epi16(c.r_v),
+            _mm512_set1_epi16(c.g_u),
+            _mm512_set1_epi16(c.g_v),
+            _mm512_set1_epi16(c.b_u),
+            _mm512_set1_epi16(128),
+            _mm512_set1_epi16(255),
+            _mm512_set1_epi16((short)0xff00),
+            _mm512_load_si512(dup),
+            _mm512_load_si512(dup + 32),
+            _mm512_setr_epi64(0, 1, 8, 9, 2, 3, 10, 11),
+            _mm512_setr_epi64(4, 5, 12, 13, 6, 7, 14, 15)};
+}
+
+// 32 pixels from 16 bit lanes in pixel order
+TARGET_AVX512 static inline void store32_avx512(__m512i y, __m512i u, __m512i v, const CoefsAvx512& c, uint8_t* rgba)
+{
+    u = _mm512_sub_epi16(u, c.c128);
+    v = _mm512_sub_epi16(v, c.c128);
+    const __m512i yy = _mm512_add_epi16(_mm512_mullo_epi16(_mm512_sub_epi16(y, c.y_offset), c.y_gain), c.round);
+    __m512i r = _mm512_srai_epi16(_mm512_adds_epi16(yy, _mm512_mullo_epi16(v, c.r_v)), 6);
+    __m512i g = _mm512_srai_epi16(
+        _mm512_subs_epi16(_mm512_subs_epi16(yy, _mm512_mullo_epi16(u, c.g_u)), _mm512_mullo_epi16(v, c.g_v)), 6);
+    __m512i b = _mm512_srai_epi16(_mm512_adds_epi16(yy, _mm512_mullo_epi16(u, c.b_u)), 6);
+
+    const __m512i zero = _mm512_setzero_si512();
+    r = _mm512_min_epi16(_mm512_max_epi16(r, zero), c.max);
+    g = _mm512_min_epi16(_mm512_max_epi16(g, zero), c.max);
+    b = _mm512_min_epi16(_mm512_max_epi16(b, zero), c.max);
+
+    const __m512i rg = _mm512_or_si512(r, _mm512_slli_epi16(g, 8));
+    const __m512i ba = _mm512_or_si512(b, c.alpha);
+    /* Lane k of lo holds pixels 8k to 8k+3, of hi 8k+4 to 8k+7 */
+    const __m512i lo = _mm512_unpacklo_epi16(rg, ba);
+    const __m512i hi = _mm512_unpackhi_epi16(rg, ba);
+    _mm512_storeu_si512(rgba, _mm512_permutex2var_epi64(lo, c.order_lo, hi));
+    _mm512_storeu_si512(rgba + 64, _mm512_permutex2var_epi64(lo, c.order_hi, hi));
+}
+
+// u, v: 32 chroma samples in 16 bit lanes
+TARGET_AVX512 static inline void store64_avx512(const uint8_t* y, __m512i u, __m512i v, const CoefsAvx512& c,
+                                                uint8_t* rgba)
+{
+    const __m512i yv = _mm512_loadu_si512(y);
+    store32_avx512(_mm512_cvtepu8_epi16(_mm512_castsi512_si256(yv)), _mm512_permutexvar_epi16(c.dup_lo, u),
+                   _mm512_permutexvar_epi16(c.dup_lo, v), c, rgba);
+    store32_avx512(_mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(yv, 1)), _mm512_permutexvar_epi16(c.dup_hi, u),
+                   _mm512_permutexvar_epi16(c.dup_hi, v), c, rgba + 128);
+}
+
+TARGET_AVX512 static void row_i420_avx512(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba,
+                                          int width, const YuvToRgba::Coefficients& coefs)
+{
+    const CoefsAvx512 c = load_coefs_avx512(coefs);
+    int x = 0;
+    for (; x + 64 <= width; x += 64)
+    {
+        store64_avx512(y + x, _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(u + x / 2))),
+                       _mm512_cvtepu8_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(v + x / 2))), c,
+                       rgba + 4 * x);
+    }
+    row_i420_avx2(y + x, u + x / 2, v + x / 2, rgba + 4 * x, width - x, coefs);
+}
+
+TARGET_AVX512 static void row_nv12_avx512(const uint8_t* y, const uint8_t* uv, const uint8_t*, uint8_t* rgba, int width,
+                                          const YuvToRgba::Coefficients& coefs)
+{
+    const CoefsAvx512 c = load_coefs_avx512(coefs);
+    const __m512i low_bytes = _mm512_set1_epi16(0xff);
+    int x = 0;
+    for (; x + 64 <= width; x += 64)
+    {
+        const __m512i uvv = _mm512_loadu_si512(uv + x);
+        store64_avx512(y + x, _mm512_and_si512(uvv, low_bytes), _mm512_srli_epi16(uvv, 8), c, rgba + 4 * x);
+    }
+    row_nv12_avx2(y + x, uv + x, nullptr, rgba + 4 * x, width - x, coefs);
+}
+
+#endif // YUV_X86
+
+#ifdef YUV_NEON
+
+/* NEON: 16 pixels per iteration */
+
+static inline uint8x8_t channel_neon(int16x8_t value) { return vqmovun_s16(vshrq_n_s16(value, 6)); }
+
+// 8 pixels from 16 bit lanes, chroma already centered
+static inline void convert8_neon(int16x8_t y, int16x8_t u, int16x8_t v, const YuvToRgba::Coefficients& c,
+                                 uint8x8_t* r, uint8x8_t* g, uint8x8_t* b)
+{
+    const int16x8_t yy =
+        vaddq_s16(vmulq_s16(vsubq_s16(y, vdupq_n_s16(c.y_offset)), vdupq_n_s16(c.y_gain)), vdupq_n_s16(32));
+    *r = channel_neon(vqaddq_s16(yy, vmulq_s16(v, vdupq_n_s16(c.r_v))));
+    *g = channel_neon(
+        vqsubq_s16(vqsubq_s16(yy, vmulq_s16(u, vdupq_n_s16(c.g_u))), vmulq_s16(v, vdupq_n_s16(c.g_v))));
+    *b = channel_neon(vqaddq_s16(yy, vmulq_s16(u, vdupq_n_s16(c.b_u))));
+}
+
+static inline int16x8_t centered_neon(uint8x8_t chroma)
+{
+    return vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(chroma)), vdupq_n_s16(128));
+}
+
+static inline void store16_neon(const uint8_t* y, uint8x8_t u8, uint8x8_t v8, const YuvToRgba::Coefficients& c,
+                                uint8_t* rgba)
+{
+    const uint8x16_t yv = vld1q_u8(y);
+    const uint8x8x2_t ud = vzip_u8(u8, u8);
+    const uint8x8x2_t vd = vzip_u8(v8, v8);
+
+    uint8x8_t r_lo, g_lo, b_lo, r_hi, g_hi, b_hi;
+    convert8_neon(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(yv))), centered_neon(ud.val[0]), centered_neon(vd.val[0]),
+                  c, &r_lo, &g_lo, &b_lo);
+    convert8_neon(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(yv))), centered_neon(ud.val[1]),
+                  centered_neon(vd.val[1]), c, &r_hi, &g_hi, &b_hi);
+
+    uint8x16x4_t out;
+    out.val[0] = vcombine_u8(r_lo, r_hi);
+    out.val[1] = vcombine_u8(g_lo, g_hi);
+    out.val[2] = vcombine_u8(b_lo, b_hi);
+    out.val[3] = vdupq_n_u8(255);
+    vst4q_u8(rgba, out);
+}
+
+static void row_i420_neon(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba, int width,
+                          const YuvToRgba::Coefficients& coefs)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+        store16_neon(y + x, vld1_u8(u + x / 2), vld1_u8(v + x / 2), coefs, rgba + 4 * x);
+    row_i420_scalar(y + x, u + x / 2, v + x / 2, rgba + 4 * x, width - x, coefs);
+}
+
+static void row_nv12_neon(const uint8_t* y, const uint8_t* uv, const uint8_t*, uint8_t* rgba, int width,
+                          const YuvToRgba::Coefficients& coefs)
+{
+    int x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        const uint8x8x2_t split = vld2_u8(uv + x);
+        store16_neon(y + x, split.val[0], split.val[1], coefs, rgba + 4 * x);
+    }
+    row_nv12_scalar(y + x, uv + x, nullptr, rgba + 4 * x, width - x, coefs);
+}
+
+#endif // YUV_NEON
+
+YuvToRgba::Isa YuvToRgba::detect()
+{
+#ifdef YUV_X86
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    const int max_leaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0 && (info[2] & (1 << 9)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    int ext[4] = {0, 0, 0, 0};
+    if (max_leaf >= 7)
+        __cpuidex(ext, 7, 0);
+    /* The OS must save the YMM (and ZMM) registers */
+    const bool avx2 = (ext[1] & (1 << 5)) != 0 && (xcr0 & 0x6) == 0x6;
+    const bool avx512 = (ext[1] & (1 << 16)) != 0 && (ext[1] & (1 << 30)) != 0 && (xcr0 & 0xe6) == 0xe6;
+#else
+    __builtin_cpu_init();
+    const bool sse41 = __builtin_cpu_supports("sse4.1");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+    const bool avx512 = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+    if (avx512)
+        return Isa::AVX512;
+    if (avx2)
+        return Isa::AVX2;
+    if (sse41)
+        return Isa::SSE41;
+#elif defined(YUV_NEON)
+    return Isa::NEON;
+#endif
+    return Isa::Scalar;
+}
+
+YuvToRgba::Isa YuvToRgba::GetIsa()
+{
+    static const Isa isa = detect();
+    return isa;
+}
+
+void YuvToRgba::SetIsa(Isa isa) { s_isa_limit = isa; }
+
+const char* YuvToRgba::GetIsaName(Isa isa)
+{
+    switch (isa)
+    {
+        case Isa::SSE41:
+            return "SSE4.1";
+        case Isa::AVX2:
+            return "AVX2";
+        case Isa::AVX512:
+            return "AVX-512";
+        case Isa::NEON:
+            return "NEON";
+        default:
+            return "scalar";
+    }
+}
+
+YuvToRgba::Kernels YuvToRgba::select(Isa isa)
+{
+    switch (isa)
+    {
+#ifdef YUV_X86
+        case Isa::AVX512:
+            return {isa, row_i420_avx512, row_nv12_avx512};
+        case Isa::AVX2:
+            return {isa, row_i420_avx2, row_nv12_avx2};
+        case Isa::SSE41:
+            return {isa, row_i420_sse41, row_nv12_sse41};
+#endif
+#ifdef YUV_NEON
+        case Isa::NEON:
+            return {isa, row_i420_neon, row_nv12_neon};
+#endif
+        default:
+            return {Isa::Scalar, row_i420_scalar, row_nv12_scalar};
+    }
+}
+
+void YuvToRgba::Convert(Format format, const uint8_t* const planes[3], const int strides[3], uint8_t* rgba,
+                        int rgba_stride, int width, int first_row, int last_row, const Coefficients& coefs)
+{
+    /* Isa values are ordered by capability on each architecture */
+    const Isa isa = std::min(GetIsa(), s_isa_limit.load(std::memory_order_relaxed));
+    const Kernels kernels = select(isa);
+
+    for (int row = first_row; row < last_row; row++)
+    {
+        const uint8_t* y = planes[0] + (size_t)row * strides[0];
+        const uint8_t* u = planes[1] + (size_t)(row / 2) * strides[1];
+        uint8_t* out = rgba + (size_t)row * rgba_stride;
+        if (format == Format::NV12)
+            kernels.nv12(y, u, nullptr, out, width, coefs);
+        else
+            kernels.i420(y, u, planes[2] + (size_t)(row / 2) * strides[2], out, width, coefs);
+    }
+}
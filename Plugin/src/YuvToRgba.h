@@ -0,0 +1,66 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+#pragma once
+#include <cstdint>
+
+/* NV12 / I420 to RGBA conversion for the system memory backend.
+ * Vectorized with SSE4.1, AVX2, AVX-512 (BW) or NEON, picked at runtime, with a scalar fallback.
+ * All paths use the same 6 bit fixed point arithmetic and give the same result.
+ * Chroma is upsampled by replication. */
+class YuvToRgba
+{
+public:
+    enum class Format
+    {
+        I420,
+        NV12
+    };
+
+    enum class Isa
+    {
+        Scalar,
+        SSE41,
+        AVX2,
+        AVX512,
+        NEON
+    };
+
+    // Fixed point matrix, 6 fractional bits
+    struct Coefficients
+    {
+        int16_t y_offset;
+        int16_t y_gain;
+        int16_t r_v;
+        int16_t g_u;
+        int16_t g_v;
+        int16_t b_u;
+    };
+
+    // kr, kb: luma weights of the matrix (0.299, 0.114 for BT.601, 0.2126, 0.0722 for BT.709)
+    static Coefficients GetCoefficients(double kr, double kb, bool full_range);
+
+    // Converts rows [first_row, last_row) of the frame. planes and strides follow GstVideoFrame (2 planes for NV12).
+    static void Convert(Format format, const uint8_t* const planes[3], const int strides[3], uint8_t* rgba,
+                        int rgba_stride, int width, int first_row, int last_row, const Coefficients& coefs);
+
+    // Best instruction set of this CPU, detected once
+    static Isa GetIsa();
+    // Restricts the kernels to isa (or the best one below it supported by the CPU), for comparisons
+    static void SetIsa(Isa isa);
+    static const char* GetIsaName(Isa isa);
+
+private:
+    using RowFunc = void (*)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* rgba, int width,
+                             const Coefficients& coefs);
+    struct Kernels
+    {
+        Isa isa;
+        RowFunc i420;
+        RowFunc nv12; // u points to the interleaved UV row, v is unused
+    };
+
+    static Kernels select(Isa isa);
+    static Isa detect();
+};
@@ -0,0 +1,144 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+/* Feeds StereoPairer with simulated eye streams on a simulated clock, one Update per rendered frame.
+ * - Both eyes in step: every frame is presented as a pair.
+ * - One eye alone (the other paused, stalled or not streaming): it is presented after max_wait, then every frame.
+ * - A constant PTS offset larger than the tolerance: nothing is matched, yet neither eye starves.
+ * With PresentPrevious, unmatched samples are never presented. */
+
+#include "StereoPairer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <gst/gst.h>
+
+static constexpr gint64 FRAME_US = 16667; // 60 fps render loop and streams
+static constexpr gint64 MAX_WAIT_US = 20000;
+static constexpr GstClockTime TOLERANCE = 8 * GST_MSECOND;
+static constexpr int FRAMES = 120;
+
+struct Counts
+{
+    guint64 matched = 0;
+    int presented[2] = {0, 0};
+    int longest_gap[2] = {0, 0}; // most frames in a row without a new sample of the eye, once it was first shown
+};
+
+static GstSample* make_sample(GstClockTime pts)
+{
+    GstBuffer* buffer = gst_buffer_new();
+    GST_BUFFER_PTS(buffer) = pts;
+    GstSample* sample = gst_sample_new(buffer, nullptr, nullptr, nullptr);
+    gst_buffer_unref(buffer);
+    return sample;
+}
+
+/* Each eye sends one sample per frame when enabled, the right one offset_ns later than the left one */
+static Counts run(StereoPairer::LatePolicy policy, bool left_on, bool right_on, GstClockTimeDiff offset_ns)
+{
+    StereoPairer pairer;
+    pairer.Configure(true, policy, MAX_WAIT_US, TOLERANCE);
+
+    Counts counts;
+    int gap[2] = {-1, -1};
+    for (int frame = 0; frame < FRAMES; frame++)
+    {
+        const GstClockTime pts = GST_SECOND + frame * FRAME_US * GST_USECOND;
+        GstSample* left = left_on ? make_sample(pts) : nullptr;
+        GstSample* right = right_on ? make_sample(pts + offset_ns) : nullptr;
+        GstSample* out[2] = {nullptr, nullptr};
+        pairer.Update(left, right, &out[0], &out[1], frame * FRAME_US);
+
+        for (int eye = 0; eye < 2; eye++)
+        {
+            if (out[eye] != nullptr)
+            {
+                counts.presented[eye]++;
+                gap[eye] = 0;
+                gst_sample_unref(out[eye]);
+            }
+            else if (gap[eye] >= 0 && ++gap[eye] > counts.longest_gap[eye])
+            {
+                counts.longest_gap[eye] = gap[eye];
+            }
+        }
+    }
+    counts.matched = pairer.GetMatched();
+    return counts;
+}
+
+static bool check(const char* name, bool condition)
+{
+    printf("    %-60s %s\n", name, condition ? "ok" : "FAILED");
+    return condition;
+}
+
+int main(int argc, char* argv[])
+{
+    gst_init(&argc, &argv);
+    printf("%d frames of %.1f ms, max wait %.1f ms, tolerance %.1f ms\n", FRAMES, FRAME_US / 1000.0,
+           MAX_WAIT_US / 1000.0, (double)TOLERANCE / GST_MSECOND);
+
+    bool ok = true;
+    const StereoPairer::LatePolicy unmatched = StereoPairer::LatePolicy::PresentUnmatched;
+    const StereoPairer::LatePolicy previous = StereoPairer::LatePolicy::PresentPrevious;
+
+    printf("In step, 2 ms apart\n");
+    Counts counts = run(unmatched, true, true, 2 * GST_MSECOND);
+    ok = check("every frame is a pair", counts.matched == FRAMES) && ok;
+
+    /* The lone eye waits max_wait once, then the pairer stops waiting for a partner that sends nothing */
+    const int first_wait = (int)((MAX_WAIT_US + FRAME_US - 1) / FRAME_US);
+    for (int eye = 0; eye < 2; eye++)
+    {
+        printf("%s eye alone\n", eye == 0 ? "Left" : "Right");
+        counts = run(unmatched, eye == 0, eye == 1, 0);
+        ok = check("presented every frame after max wait", counts.presented[eye] == FRAMES - first_wait) && ok;
+        ok = check("no gap", counts.longest_gap[eye] == 0) && ok;
+        counts = run(previous, eye == 0, eye == 1, 0);
+        ok = check("never presented with PresentPrevious", counts.presented[eye] == 0) && ok;
+    }
+
+    printf("Right eye alone, then the left one resumes\n");
+    {
+        StereoPairer pairer;
+        pairer.Configure(true, unmatched, MAX_WAIT_US, TOLERANCE);
+        for (int frame = 0; frame < FRAMES; frame++)
+        {
+            const GstClockTime pts = GST_SECOND + frame * FRAME_US * GST_USECOND;
+            GstSample* left = frame >= FRAMES / 2 ? make_sample(pts) : nullptr;
+            GstSample* out[2] = {nullptr, nullptr};
+            pairer.Update(left, make_sample(pts), &out[0], &out[1], frame * FRAME_US);
+            for (GstSample* sample : out)
+            {
+                if (sample != nullptr)
+                    gst_sample_unref(sample);
+            }
+        }
+        ok = check("pairs again from the first left sample", pairer.GetMatched() == FRAMES / 2) && ok;
+    }
+
+    /* Each sample of the earlier eye is older than its partner beyond the tolerance: there is never a match, every
+     * sample goes through the late policy */
+    for (int offset_ms : {12, -12})
+    {
+        printf("Constant %d ms offset of the right eye\n", offset_ms);
+        const int older = offset_ms > 0 ? 0 : 1;
+        counts = run(unmatched, true, true, offset_ms * (GstClockTimeDiff)GST_MSECOND);
+        ok = check("no pair", counts.matched == 0) && ok;
+        ok = check("older eye presented every frame",
+                   counts.presented[older] == FRAMES && counts.longest_gap[older] == 0) &&
+             ok;
+        ok = check("newer eye presented, never later than max wait",
+                   counts.presented[1 - older] >= FRAMES / (first_wait + 1) &&
+                       counts.longest_gap[1 - older] <= first_wait) &&
+             ok;
+        counts = run(previous, true, true, offset_ms * (GstClockTimeDiff)GST_MSECOND);
+        ok = check("nothing presented with PresentPrevious", counts.presented[0] == 0 && counts.presented[1] == 0) &&
+             ok;
+    }
+
+    printf(ok ? "PASSED\n" : "FAILED\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
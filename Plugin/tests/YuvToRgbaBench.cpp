@@ -0,0 +1,164 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+/* Time per frame of the NV12 / I420 to RGBA conversion at 960x720 (one eye) and 1920x1080:
+ * the scalar path, each vector path supported by this CPU, and GstVideoConverter as videoconvert sets it up,
+ * all on one thread. Then the scaling of CpuFrameSink::DrawBatch with both 960x720 eyes from 1 to 8 threads. */
+
+#include "CpuFrameSink.h"
+#include "YuvToRgba.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <thread>
+#include <vector>
+
+// Each measure repeats the conversion for at least that long
+static constexpr double MIN_DURATION_S = 0.5;
+static constexpr int MIN_ITERATIONS = 10;
+
+// Average milliseconds per call
+static double measure(const std::function<void()>& run)
+{
+    run(); // warm up caches and lazy allocations
+    const auto start = std::chrono::steady_clock::now();
+    int iterations = 0;
+    double elapsed = 0.0;
+    do
+    {
+        run();
+        iterations++;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < MIN_DURATION_S || iterations < MIN_ITERATIONS);
+    return elapsed * 1000.0 / iterations;
+}
+
+static GstBuffer* make_frame(const GstVideoInfo* info)
+{
+    GstBuffer* buffer = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(info), nullptr);
+    GstMapInfo map;
+    gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+    for (gsize i = 0; i < map.size; i++)
+        map.data[i] = static_cast<guint8>(i * 7 + (i >> 11));
+    gst_buffer_unmap(buffer, &map);
+    return buffer;
+}
+
+static void print_result(const char* name, double ms, double reference_ms, int width, int height)
+{
+    printf("    %-16s %8.3f ms  %8.1f Mpix/s  x%.2f\n", name, ms, width * height / (ms * 1000.0), reference_ms / ms);
+}
+
+static void bench_conversion(GstVideoFormat format, int width, int height)
+{
+    GstVideoInfo in_info, out_info;
+    gst_video_info_set_format(&in_info, format, width, height);
+    in_info.colorimetry.matrix = GST_VIDEO_COLOR_MATRIX_BT709;
+    in_info.colorimetry.range = GST_VIDEO_COLOR_RANGE_16_235;
+    gst_video_info_set_format(&out_info, GST_VIDEO_FORMAT_RGBA, width, height);
+
+    GstBuffer* input = make_frame(&in_info);
+    GstBuffer* output = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(&out_info), nullptr);
+    GstVideoFrame in_frame, out_frame;
+    gst_video_frame_map(&in_frame, &in_info, input, GST_MAP_READ);
+    gst_video_frame_map(&out_frame, &out_info, output, GST_MAP_WRITE);
+
+    printf("%s %dx%d\n", gst_video_format_to_string(format), width, height);
+
+    /* GstVideoConverter with the defaults of videoconvert, the reference of the speed-ups */
+    GstVideoConverter* conv = gst_video_converter_new(&in_info, &out_info, nullptr);
+    const double converter_ms = measure([&]() { gst_video_converter_frame(conv, &in_frame, &out_frame); });
+    gst_video_converter_free(conv);
+    print_result("GstVideoConverter", converter_ms, converter_ms, width, height);
+
+    const uint8_t* planes[3] = {nullptr};
+    int strides[3] = {0};
+    for (guint i = 0; i < GST_VIDEO_FRAME_N_PLANES(&in_frame) && i < 3; i++)
+    {
+        planes[i] = static_cast<const uint8_t*>(GST_VIDEO_FRAME_PLANE_DATA(&in_frame, i));
+        strides[i] = GST_VIDEO_FRAME_PLANE_STRIDE(&in_frame, i);
+    }
+    const YuvToRgba::Coefficients coefs = YuvToRgba::GetCoefficients(0.2126, 0.0722, false);
+    const YuvToRgba::Format kernel_format =
+        format == GST_VIDEO_FORMAT_NV12 ? YuvToRgba::Format::NV12 : YuvToRgba::Format::I420;
+
+    /* Isa values are ordered by capability on each architecture, the ones above GetIsa do not run here */
+    for (int isa = (int)YuvToRgba::Isa::Scalar; isa <= (int)YuvToRgba::GetIsa(); isa++)
+    {
+        YuvToRgba::SetIsa((YuvToRgba::Isa)isa);
+        const double ms = measure(
+            [&]()
+            {
+                YuvToRgba::Convert(kernel_format, planes, strides,
+                                   static_cast<uint8_t*>(GST_VIDEO_FRAME_PLANE_DATA(&out_frame, 0)),
+                                   GST_VIDEO_FRAME_PLANE_STRIDE(&out_frame, 0), width, 0, height, coefs);
+            });
+        print_result(YuvToRgba::GetIsaName((YuvToRgba::Isa)isa), ms, converter_ms, width, height);
+    }
+    YuvToRgba::SetIsa(YuvToRgba::GetIsa());
+
+    gst_video_frame_unmap(&out_frame);
+    gst_video_frame_unmap(&in_frame);
+    gst_buffer_unref(output);
+    gst_buffer_unref(input);
+}
+
+// Both eyes drawn by one DrawBatch, the worker pool converting them concurrently in row slices
+static void bench_threads(GstVideoFormat format)
+{
+    const int width = 960;
+    const int height = 720;
+    GstVideoInfo info;
+    gst_video_info_set_format(&info, format, width, height);
+    info.colorimetry.matrix = GST_VIDEO_COLOR_MATRIX_BT709;
+    info.colorimetry.range = GST_VIDEO_COLOR_RANGE_16_235;
+    GstCaps* caps = gst_video_info_to_caps(&info);
+
+    CpuFrameSink sink;
+    const int streams[2] = {0, 1};
+    GstSample* samples[2];
+    for (int eye = 0; eye < 2; eye++)
+    {
+        sink.CreateTexture(width, height, eye);
+        GstBuffer* buffer = make_frame(&info);
+        samples[eye] = gst_sample_new(buffer, caps, nullptr, nullptr);
+        gst_buffer_unref(buffer);
+    }
+    gst_caps_unref(caps);
+
+    printf("DrawBatch, two %s %dx%d eyes, %s kernels, %u cores\n", gst_video_format_to_string(format), width, height,
+           YuvToRgba::GetIsaName(YuvToRgba::GetIsa()), std::thread::hardware_concurrency());
+    double single_ms = 0.0;
+    for (unsigned int threads = 1; threads <= 8; threads++)
+    {
+        sink.SetThreadCount(threads);
+        const double ms = measure([&]() { sink.DrawBatch(streams, samples, 2); });
+        if (threads == 1)
+            single_ms = ms;
+        printf("    %u thread%s %8.3f ms  %8.1f fps  x%.2f\n", threads, threads > 1 ? "s" : " ", ms, 1000.0 / ms,
+               single_ms / ms);
+    }
+
+    for (GstSample* sample : samples)
+        gst_sample_unref(sample);
+}
+
+int main(int argc, char* argv[])
+{
+    gst_init(&argc, &argv);
+    printf("Best kernels of this CPU: %s\n\n", YuvToRgba::GetIsaName(YuvToRgba::GetIsa()));
+
+    for (GstVideoFormat format : {GST_VIDEO_FORMAT_NV12, GST_VIDEO_FORMAT_I420})
+    {
+        bench_conversion(format, 960, 720);
+        bench_conversion(format, 1920, 1080);
+    }
+    printf("\n");
+    for (GstVideoFormat format : {GST_VIDEO_FORMAT_NV12, GST_VIDEO_FORMAT_I420})
+        bench_threads(format);
+    return 0;
+}
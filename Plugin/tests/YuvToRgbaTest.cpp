@@ -0,0 +1,294 @@
+/* Copyright(c) Pollen Robotics, all rights reserved.
+ This source code is licensed under the license found in the
+ LICENSE file in the root directory of this source tree. */
+
+/* Compares YuvToRgba with videoconvert on NV12 and I420, BT.601 and BT.709, full and limited range.
+ * - Smooth content against videoconvert with its default settings: chroma interpolation barely matters there.
+ * - Chroma edges (a random color per 2x2 block) against videoconvert with nearest chroma resampling, which replicates
+ *   chroma as the kernels do: only the arithmetic differs.
+ * - Chroma edges against videoconvert with its default settings: the error of replicating chroma instead of
+ *   interpolating it is reported, not checked.
+ * The checked cases must stay within TOLERANCE per channel and MEAN_TOLERANCE on average. Every vector path must also
+ * give exactly the result of the scalar one. */
+
+#include "YuvToRgba.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <gst/app/app.h>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <vector>
+
+// Kernels use 6 bit coefficients, videoconvert 8 bit ones: both round differently, up to 2 each
+static constexpr int TOLERANCE = 4;
+static constexpr double MEAN_TOLERANCE = 1.0;
+
+// Not a multiple of any vector width, so that every tail path runs
+static constexpr int WIDTH = 1000;
+static constexpr int HEIGHT = 562;
+
+enum class Pattern
+{
+    Smooth,
+    ChromaEdges
+};
+
+struct Error
+{
+    int max = 0;
+    double mean = 0.0;
+    double over = 0.0; // share of channels beyond TOLERANCE
+};
+
+static guint32 s_random = 0x12345678;
+
+static guint8 random8()
+{
+    s_random ^= s_random << 13;
+    s_random ^= s_random >> 17;
+    s_random ^= s_random << 5;
+    return static_cast<guint8>(s_random >> 24);
+}
+
+static void fill_frame(GstVideoFrame* frame, Pattern pattern)
+{
+    const int width = GST_VIDEO_FRAME_WIDTH(frame);
+    const int height = GST_VIDEO_FRAME_HEIGHT(frame);
+    const bool nv12 = GST_VIDEO_FRAME_FORMAT(frame) == GST_VIDEO_FORMAT_NV12;
+
+    for (int y = 0; y < height; y++)
+    {
+        guint8* row = static_cast<guint8*>(GST_VIDEO_FRAME_PLANE_DATA(frame, 0)) + y * GST_VIDEO_FRAME_PLANE_STRIDE(frame, 0);
+        for (int x = 0; x < width; x++)
+            row[x] = pattern == Pattern::Smooth ? static_cast<guint8>((x + y) * 255 / (width + height)) : random8();
+    }
+
+    const int chroma_width = (width + 1) / 2;
+    const int chroma_height = (height + 1) / 2;
+    for (int y = 0; y < chroma_height; y++)
+    {
+        guint8* u = static_cast<guint8*>(GST_VIDEO_FRAME_PLANE_DATA(frame, 1)) + y * GST_VIDEO_FRAME_PLANE_STRIDE(frame, 1);
+        guint8* v = nv12 ? u + 1
+                         : static_cast<guint8*>(GST_VIDEO_FRAME_PLANE_DATA(frame, 2)) +
+                               y * GST_VIDEO_FRAME_PLANE_STRIDE(frame, 2);
+        const int step = nv12 ? 2 : 1;
+        for (int x = 0; x < chroma_width; x++)
+        {
+            if (pattern == Pattern::Smooth)
+            {
+                u[x * step] = static_cast<guint8>(128 + 100 * std::sin(6.283 * x / chroma_width));
+                v[x * step] = static_cast<guint8>(128 + 100 * std::cos(6.283 * y / chroma_height));
+            }
+            else
+            {
+                u[x * step] = random8();
+                v[x * step] = random8();
+            }
+        }
+    }
+}
+
+static GstBuffer* make_frame(const GstVideoInfo* info, Pattern pattern)
+{
+    GstBuffer* buffer = gst_buffer_new_allocate(nullptr, GST_VIDEO_INFO_SIZE(info), nullptr);
+    GstVideoFrame frame;
+    gst_video_frame_map(&frame, info, buffer, GST_MAP_WRITE);
+    fill_frame(&frame, pattern);
+    gst_video_frame_unmap(&frame);
+    GST_BUFFER_PTS(buffer) = 0;
+    return buffer;
+}
+
+// Tightly packed RGBA through appsrc ! videoconvert ! appsink
+static bool run_videoconvert(const GstVideoInfo* info, GstBuffer* input, bool nearest, std::vector<guint8>* rgba)
+{
+    GError* error = nullptr;
+    GstElement* pipeline = gst_parse_launch("appsrc name=src format=time ! videoconvert name=convert ! "
+                                            "video/x-raw,format=RGBA ! appsink name=sink sync=false",
+                                            &error);
+    if (pipeline == nullptr)
+    {
+        fprintf(stderr, "Cannot build the videoconvert pipeline: %s\n", error->message);
+        g_error_free(error);
+        return false;
+    }
+
+    GstElement* src = gst_bin_get_by_name(GST_BIN(pipeline), "src");
+    GstElement* convert = gst_bin_get_by_name(GST_BIN(pipeline), "convert");
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+    if (nearest)
+    {
+        gst_util_set_object_arg(G_OBJECT(convert), "chroma-resampler", "nearest");
+        gst_util_set_object_arg(G_OBJECT(convert), "dither", "none");
+    }
+    GstCaps* caps = gst_video_info_to_caps(info);
+    g_object_set(src, "caps", caps, nullptr);
+    gst_caps_unref(caps);
+
+    gst_element_set_state(pipeline, GST_STATE_PLAYING);
+    gst_app_src_push_buffer(GST_APP_SRC(src), gst_buffer_ref(input));
+    gst_app_src_end_of_stream(GST_APP_SRC(src));
+    GstSample* sample = gst_app_sink_try_pull_sample(GST_APP_SINK(sink), 10 * GST_SECOND);
+
+    bool done = false;
+    GstVideoInfo out_info;
+    GstVideoFrame frame;
+    if (sample != nullptr && gst_video_info_from_caps(&out_info, gst_sample_get_caps(sample)) &&
+        gst_video_frame_map(&frame, &out_info, gst_sample_get_buffer(sample), GST_MAP_READ))
+    {
+        const int row_size = GST_VIDEO_INFO_WIDTH(info) * 4;
+        rgba->resize((size_t)row_size * GST_VIDEO_INFO_HEIGHT(info));
+        for (int y = 0; y < GST_VIDEO_INFO_HEIGHT(info); y++)
+        {
+            memcpy(rgba->data() + (size_t)y * row_size,
+                   static_cast<const guint8*>(GST_VIDEO_FRAME_PLANE_DATA(&frame, 0)) +
+                       (size_t)y * GST_VIDEO_FRAME_PLANE_STRIDE(&frame, 0),
+                   row_size);
+        }
+        gst_video_frame_unmap(&frame);
+        done = true;
+    }
+    else
+    {
+        fprintf(stderr, "No frame out of videoconvert\n");
+    }
+
+    if (sample != nullptr)
+        gst_sample_unref(sample);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(sink);
+    gst_object_unref(convert);
+    gst_object_unref(src);
+    gst_object_unref(pipeline);
+    return done;
+}
+
+// Tightly packed RGBA through YuvToRgba, with the coefficients CpuFrameSink derives from the caps
+static void run_kernels(const GstVideoInfo* info, GstBuffer* input, std::vector<guint8>* rgba)
+{
+    GstVideoFrame frame;
+    gst_video_frame_map(&frame, info, input, GST_MAP_READ);
+    const uint8_t* planes[3] = {nullptr};
+    int strides[3] = {0};
+    for (guint i = 0; i < GST_VIDEO_FRAME_N_PLANES(&frame) && i < 3; i++)
+    {
+        planes[i] = static_cast<const uint8_t*>(GST_VIDEO_FRAME_PLANE_DATA(&frame, i));
+        strides[i] = GST_VIDEO_FRAME_PLANE_STRIDE(&frame, i);
+    }
+
+    gdouble kr, kb;
+    gst_video_color_matrix_get_Kr_Kb(info->colorimetry.matrix, &kr, &kb);
+    const YuvToRgba::Coefficients coefs =
+        YuvToRgba::GetCoefficients(kr, kb, info->colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255);
+    const YuvToRgba::Format format =
+        GST_VIDEO_INFO_FORMAT(info) == GST_VIDEO_FORMAT_NV12 ? YuvToRgba::Format::NV12 : YuvToRgba::Format::I420;
+
+    const int width = GST_VIDEO_INFO_WIDTH(info);
+    rgba->assign((size_t)width * 4 * GST_VIDEO_INFO_HEIGHT(info), 0);
+    YuvToRgba::Convert(format, planes, strides, rgba->data(), width * 4, width, 0, GST_VIDEO_INFO_HEIGHT(info), coefs);
+    gst_video_frame_unmap(&frame);
+}
+
+static Error compare(const std::vector<guint8>& a, const std::vector<guint8>& b)
+{
+    Error error;
+    guint64 sum = 0, over = 0, channels = 0;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (i % 4 == 3)
+            continue; // alpha
+        const int diff = std::abs((int)a[i] - (int)b[i]);
+        error.max = std::max(error.max, diff);
+        sum += diff;
+        over += diff > TOLERANCE;
+        channels++;
+    }
+    error.mean = (double)sum / channels;
+    error.over = (double)over / channels;
+    return error;
+}
+
+// Returns false if a checked comparison fails
+static bool run_case(GstVideoFormat format, GstVideoColorMatrix matrix, GstVideoColorRange range)
+{
+    GstVideoInfo info;
+    gst_video_info_set_format(&info, format, WIDTH, HEIGHT);
+    info.colorimetry.matrix = matrix;
+    info.colorimetry.range = range;
+    info.colorimetry.transfer = GST_VIDEO_TRANSFER_BT709;
+    info.colorimetry.primaries = GST_VIDEO_COLOR_PRIMARIES_BT709;
+
+    char name[64];
+    snprintf(name, sizeof(name), "%s %s %s", gst_video_format_to_string(format),
+             matrix == GST_VIDEO_COLOR_MATRIX_BT601 ? "BT.601" : "BT.709",
+             range == GST_VIDEO_COLOR_RANGE_0_255 ? "full   " : "limited");
+
+    bool ok = true;
+    for (Pattern pattern : {Pattern::Smooth, Pattern::ChromaEdges})
+    {
+        GstBuffer* input = make_frame(&info, pattern);
+
+        /* Reference: the scalar path. Every vector path must match it exactly. */
+        std::vector<guint8> scalar, kernels;
+        YuvToRgba::SetIsa(YuvToRgba::Isa::Scalar);
+        run_kernels(&info, input, &scalar);
+        for (int isa = (int)YuvToRgba::Isa::SSE41; isa <= (int)YuvToRgba::GetIsa(); isa++)
+        {
+            YuvToRgba::SetIsa((YuvToRgba::Isa)isa);
+            run_kernels(&info, input, &kernels);
+            if (kernels != scalar)
+            {
+                printf("%s: %s differs from the scalar path\n", name, YuvToRgba::GetIsaName((YuvToRgba::Isa)isa));
+                ok = false;
+            }
+        }
+        YuvToRgba::SetIsa(YuvToRgba::GetIsa());
+
+        /* Smooth content is checked against the defaults, chroma edges against nearest resampling */
+        for (bool nearest : {false, true})
+        {
+            if (pattern == Pattern::Smooth && nearest)
+                continue;
+
+            std::vector<guint8> reference;
+            if (!run_videoconvert(&info, input, nearest, &reference))
+            {
+                ok = false;
+                continue;
+            }
+            const Error error = compare(scalar, reference);
+            const bool checked = pattern == Pattern::Smooth || nearest;
+            const bool pass = error.max <= TOLERANCE && error.mean <= MEAN_TOLERANCE;
+            printf("%s  %-12s videoconvert %-8s max %3d  mean %5.2f  over tolerance %6.2f%%  %s\n", name,
+                   pattern == Pattern::Smooth ? "smooth" : "chroma edges", nearest ? "nearest" : "default", error.max,
+                   error.mean, error.over * 100.0, checked ? (pass ? "OK" : "FAILED") : "(replication error)");
+            if (checked && !pass)
+                ok = false;
+        }
+        gst_buffer_unref(input);
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    gst_init(&argc, &argv);
+    printf("Kernels: %s, tolerance %d per channel, %.1f mean\n", YuvToRgba::GetIsaName(YuvToRgba::GetIsa()), TOLERANCE,
+           MEAN_TOLERANCE);
+
+    bool ok = true;
+    for (GstVideoFormat format : {GST_VIDEO_FORMAT_NV12, GST_VIDEO_FORMAT_I420})
+    {
+        for (GstVideoColorMatrix matrix : {GST_VIDEO_COLOR_MATRIX_BT601, GST_VIDEO_COLOR_MATRIX_BT709})
+        {
+            for (GstVideoColorRange range : {GST_VIDEO_COLOR_RANGE_0_255, GST_VIDEO_COLOR_RANGE_16_235})
+                ok = run_case(format, matrix, range) && ok;
+        }
+    }
+
+    printf(ok ? "PASSED\n" : "FAILED\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}